@@ -0,0 +1,248 @@
+// benchmarks/bench.cpp
+//
+// Benchmarks for the library's hot paths: SHA-256, Merkle tree construction, block sealing,
+// chain validation and block store persistence. Results are printed as a table, or as JSON
+// with --json for benchmarks/compare.py. Every run first checks the SHA-256 implementations against
+// the standard test vectors and exits with status 1 if they disagree; --self-test stops after that.
+//
+// Usage: bench [--json] [--self-test] [--filter SUBSTRING] [--min-time SECONDS] [--repetitions N] [--max-tx N]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Blockchain.h"
+#include "MerkleTree.h"
+#include "Transaction.h"
+#include "sha256.h"
+
+using namespace std;
+
+namespace {
+
+struct Options {
+    bool json = false;
+    bool selfTestOnly = false; // Run the SHA-256 self-test and no benchmarks
+    string filter; // Run only benchmarks whose name contains this
+    double minTime = 0.2; // Seconds each repetition runs for at least
+    int repetitions = 5; // Repetitions per benchmark; the median is reported
+    size_t maxTx = 1000000; // Largest Merkle tree benchmarked
+};
+
+struct Result {
+    string name;
+    uint64_t iterations; // Operations timed in the median repetition
+    double nsPerOp; // Median time per operation
+    double itemsPerSecond; // Items (transactions, blocks) per second, 0 if not applicable
+    double bytesPerSecond; // Bytes per second, 0 if not applicable
+};
+
+Options options;
+vector<Result> results;
+volatile uint8_t sink; // Keeps results observable so the compiler cannot drop the work
+
+// Time op (which performs one operation per call) in repetitions of at least minTime seconds.
+// setup, if given, runs untimed before every repetition (e.g. to reset a chain being grown).
+void run(const string& name, size_t itemsPerOp, size_t bytesPerOp, const function<void()>& op,
+         const function<void()>& setup = nullptr) {
+    if (!options.filter.empty() && name.find(options.filter) == string::npos) return;
+
+    vector<pair<double, uint64_t>> samples; // (ns per op, iterations)
+    for (int rep = 0; rep < options.repetitions; ++rep) {
+        if (setup) setup();
+        uint64_t iterations = 0;
+        const auto start = chrono::steady_clock::now();
+        double elapsed = 0;
+        do {
+            op();
+            ++iterations;
+            elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        } while (elapsed < options.minTime);
+        samples.push_back({elapsed * 1e9 / iterations, iterations});
+    }
+    sort(samples.begin(), samples.end());
+    const auto& median = samples[samples.size() / 2];
+
+    Result result{name, median.second, median.first, 0, 0};
+    if (itemsPerOp) result.itemsPerSecond = itemsPerOp * 1e9 / median.first;
+    if (bytesPerOp) result.bytesPerSecond = bytesPerOp * 1e9 / median.first;
+    results.push_back(result);
+    if (!options.json) {
+        fprintf(stderr, "%-32s %14.0f ns/op %14.0f items/s %10.1f MB/s\n", name.c_str(), result.nsPerOp,
+                result.itemsPerSecond, result.bytesPerSecond / 1e6);
+    }
+}
+
+// Deterministic transactions over a few hundred accounts, like a busy pool
+vector<Transaction> makeTransactions(size_t count, size_t seed = 0) {
+    vector<Transaction> transactions;
+    transactions.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const size_t n = i + seed * count;
+        transactions.emplace_back("account" + to_string(n % 397), "account" + to_string(n * 7 % 389),
+                                  static_cast<int64_t>(n % 100000) * 1000, 1700000000 + static_cast<int64_t>(n));
+    }
+    return transactions;
+}
+
+void benchSha256() {
+    for (size_t size : {64, 256, 1024, 4096, 65536, 1 << 20}) {
+        vector<uint8_t> input(size, 0x5a);
+        run("sha256/" + to_string(size), 0, size, [&] {
+            uint8_t digest[SIZE_OF_SHA_256_HASH];
+            calc_sha_256(digest, input.data(), input.size());
+            sink = digest[0];
+        });
+    }
+}
+
+void benchMerkleBuild() {
+    for (size_t count = 1; count <= options.maxTx; count *= 10) {
+        const vector<Transaction> transactions = makeTransactions(count);
+        run("merkle_build/" + to_string(count), count, 0, [&] {
+            MerkleTree tree(transactions);
+            sink = tree.getRootHash().bytes[0];
+        });
+    }
+}
+
+void benchAddBlock() {
+    for (size_t count : {100, 1000, 10000}) {
+        const vector<Transaction> transactions = makeTransactions(count);
+        unique_ptr<Blockchain> chain;
+        run("add_block/" + to_string(count), count, 0, [&] {
+            chain->addBlock(transactions);
+        }, [&] {
+            chain = make_unique<Blockchain>();
+        });
+    }
+}
+
+// A chain of `blocks` blocks with `txPerBlock` transactions each
+unique_ptr<Blockchain> makeChain(size_t blocks, size_t txPerBlock) {
+    auto chain = make_unique<Blockchain>();
+    for (size_t i = 0; i < blocks; ++i) {
+        chain->addBlock(makeTransactions(txPerBlock, i));
+    }
+    return chain;
+}
+
+void benchValidateChain() {
+    const size_t blocks = 1000;
+    for (size_t txPerBlock : {10, 100}) {
+        const auto chain = makeChain(blocks, txPerBlock);
+        run("validate_chain/" + to_string(blocks) + "x" + to_string(txPerBlock), blocks, 0, [&] {
+            sink = chain->validateChain();
+        });
+    }
+}
+
+void benchPersistence() {
+    const size_t blocks = 200;
+    const size_t txPerBlock = 100;
+    const auto chain = makeChain(blocks, txPerBlock);
+    const filesystem::path directory =
+        filesystem::temp_directory_path() / ("blockchain-bench-" + to_string(time(nullptr)));
+    const string path = directory.string();
+
+    // Each save writes a fresh store, so the timing includes removing the previous one
+    run("save/" + to_string(blocks) + "x" + to_string(txPerBlock), blocks, 0, [&] {
+        filesystem::remove_all(directory);
+        sink = chain->saveToFile(path);
+    });
+    filesystem::remove_all(directory);
+    chain->saveToFile(path);
+    run("load/" + to_string(blocks) + "x" + to_string(txPerBlock), blocks, 0, [&] {
+        Blockchain loaded;
+        sink = loaded.loadFromFile(path);
+    });
+    run("open_store/" + to_string(blocks) + "x" + to_string(txPerBlock), blocks, 0, [&] {
+        Blockchain opened;
+        sink = opened.openStore(path);
+    });
+    {
+        // One durable block: seal it, append it to the store's log and flush the log
+        Blockchain logged;
+        logged.openStore(path);
+        const vector<Transaction> transactions = makeTransactions(txPerBlock);
+        run("commit_block/" + to_string(txPerBlock), 1, 0, [&] {
+            logged.addBlock(transactions);
+            sink = logged.syncLog();
+        });
+        // The same with the log writer: sealing overlaps the previous blocks' writes
+        logged.startLogWriter();
+        run("commit_block_async/" + to_string(txPerBlock), 1, 0, [&] {
+            sink = logged.addBlock(transactions);
+        });
+        sink = logged.syncLog();
+    }
+    filesystem::remove_all(directory);
+}
+
+void printJson() {
+    printf("{\n  \"context\": {\"hardware_threads\": %u, \"sha_hw\": %s, \"sha_lanes\": %d},\n",
+           thread::hardware_concurrency(), sha_256_hw_available() ? "true" : "false", sha_256_many_lanes());
+    printf("  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        printf("    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.1f, \"items_per_second\": %.1f, "
+               "\"bytes_per_second\": %.1f}%s\n",
+               r.name.c_str(), static_cast<unsigned long long>(r.iterations), r.nsPerOp, r.itemsPerSecond,
+               r.bytesPerSecond, i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+bool parseOptions(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--json") {
+            options.json = true;
+        } else if (arg == "--self-test") {
+            options.selfTestOnly = true;
+        } else if (arg == "--filter" && hasValue) {
+            options.filter = argv[++i];
+        } else if (arg == "--min-time" && hasValue) {
+            options.minTime = atof(argv[++i]);
+        } else if (arg == "--repetitions" && hasValue) {
+            options.repetitions = max(1, atoi(argv[++i]));
+        } else if (arg == "--max-tx" && hasValue) {
+            options.maxTx = strtoull(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--json] [--self-test] [--filter SUBSTRING] [--min-time SECONDS] [--repetitions N] "
+                            "[--max-tx N]\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (!parseOptions(argc, argv)) return 2;
+
+    // Timings of a wrong hash are meaningless, so a failed self-test ends the run
+    const int failures = sha_256_self_test();
+    fprintf(stderr, "SHA-256 self-test (%s path): %s\n", sha_256_hw_available() ? "SHA-NI and portable" : "portable",
+            failures == 0 ? "passed" : "FAILED");
+    if (failures != 0) return 1;
+    if (options.selfTestOnly) return 0;
+
+    benchSha256();
+    benchMerkleBuild();
+    benchAddBlock();
+    benchValidateChain();
+    benchPersistence();
+
+    if (options.json) printJson();
+    return 0;
+}
@@ -0,0 +1,57 @@
+# Compare a benchmark run against a stored baseline and flag regressions.
+#
+# Usage: python3 benchmarks/compare.py BASELINE.json CURRENT.json [--threshold PERCENT]
+#
+# Both files are the output of `bench --json`. A benchmark regresses when its ns_per_op grew by
+# more than the threshold (default 10%). The exit status is 1 if anything regressed, so the
+# script can gate a CI job.
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        return {b["name"]: b for b in json.load(f)["benchmarks"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Flag benchmark regressions against a baseline")
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="allowed slowdown in percent before a benchmark counts as regressed")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    regressions = 0
+    print(f"{'benchmark':32} {'baseline ns':>14} {'current ns':>14} {'change':>9}")
+    for name, result in current.items():
+        if name not in baseline:
+            print(f"{name:32} {'-':>14} {result['ns_per_op']:14.0f} {'new':>9}")
+            continue
+        before = baseline[name]["ns_per_op"]
+        after = result["ns_per_op"]
+        change = (after - before) / before * 100 if before > 0 else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        elif change < -args.threshold:
+            flag = "  improved"
+        print(f"{name:32} {before:14.0f} {after:14.0f} {change:+8.1f}%{flag}")
+
+    for name in sorted(baseline.keys() - current.keys()):
+        print(f"{name:32} missing from the current run")
+
+    if regressions:
+        print(f"\n{regressions} benchmark(s) slower than the baseline by more than {args.threshold}%")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
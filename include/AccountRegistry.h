@@ -0,0 +1,42 @@
+// include/AccountRegistry.h
+
+#ifndef ACCOUNTREGISTRY_H
+#define ACCOUNTREGISTRY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Interning table mapping account names to dense 32-bit ids.
+// Names are stored once and never removed, so the views returned by name() stay valid for the
+// life of the program. Ids are assigned in first-seen order and are only meaningful within one
+// process; anything written to disk stores the names.
+// name() takes no lock: names live in chunks that never move, and a new name is published by
+// bumping an atomic count only after it is written, so readers never see a partly added entry.
+class AccountRegistry {
+public:
+    static AccountRegistry& global(); // Registry shared by every Transaction
+
+    uint32_t intern(std::string_view name); // Id of name, assigning the next free id on first sight
+    bool find(std::string_view name, uint32_t& id) const; // Look an id up without interning
+    std::string_view name(uint32_t id) const; // Name behind an id returned by intern
+    size_t size() const; // Number of interned names
+
+private:
+    static constexpr unsigned firstChunkBits = 10; // Chunk k holds 1024 << k names
+    static constexpr unsigned chunkCount = 33 - firstChunkBits; // Enough chunks for every 32-bit id
+
+    std::string& slot(uint32_t id) const; // Where the name with this id is stored
+
+    mutable std::shared_mutex mutex; // Shared for lookups in ids, exclusive while adding a name
+    std::unique_ptr<std::string[]> chunks[chunkCount]; // Names by id; allocated as needed, never moved
+    std::atomic<uint32_t> count{0}; // Names written to chunks, published after each write
+    std::unordered_map<std::string_view, uint32_t> ids; // Views into chunks -> id
+};
+
+#endif // ACCOUNTREGISTRY_H
@@ -0,0 +1,48 @@
+// include/BlockCache.h
+
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "Transaction.h"
+
+// Least-recently-used cache of block bodies with a memory budget in bytes.
+// Bodies are handed out as shared pointers, so evicting one never invalidates a caller's copy.
+class BlockCache {
+public:
+    using Body = std::shared_ptr<const std::vector<Transaction>>;
+
+    explicit BlockCache(size_t budgetBytes);
+
+    // Return the body of a block, calling load to read it on a miss. Returns null if load fails.
+    Body get(uint64_t height, const std::function<bool(std::vector<Transaction>&)>& load);
+    void setBudget(size_t budgetBytes); // Change the budget, evicting as needed
+    size_t residentBytes() const; // Estimated memory held by cached bodies
+    void clear(); // Drop every cached body
+
+    static size_t estimateBytes(const std::vector<Transaction>& transactions); // Approximate heap footprint
+
+private:
+    void evict(); // Drop least recently used bodies until within budget; caller holds mutex
+
+    struct Entry {
+        Body body;
+        size_t bytes;
+        std::list<uint64_t>::iterator position; // Place in the recency list
+    };
+
+    mutable std::mutex mutex; // Guards everything below
+    std::list<uint64_t> recency; // Heights, most recently used first
+    std::unordered_map<uint64_t, Entry> entries; // Cached bodies by height
+    size_t budget; // Memory budget in bytes
+    size_t used = 0; // Estimated bytes held
+};
+
+#endif // BLOCKCACHE_H
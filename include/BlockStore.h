@@ -0,0 +1,113 @@
+// include/BlockStore.h
+
+#ifndef BLOCKSTORE_H
+#define BLOCKSTORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Blockchain.h"
+
+class MappedFile;
+
+// Append-only binary block store kept as numbered segment files in one directory.
+//
+// Segment:  magic "BCSG" | format version (4) | height of its first block (8) | block records...
+// Record:   magic "BLK2" | body length (4) | transaction count (4) | CRC-32 (4)
+//           | canonical block header (Block::headerSize) | block hash (32) | body
+// Body:     Bloom filter: word count (4) | hash count (1) | reserved (3) | filter words (8 each)
+//           then one record per transaction: record length (4) | Transaction::encode() bytes, i.e.
+//           sender length (4) | sender | receiver length (4) | receiver | amount (8) | timestamp (8)
+//
+// Accounts are stored by name; interned ids are assigned afresh when a body is decoded.
+// All integers are little-endian. The CRC covers everything after the CRC field. A record that is
+// cut short or fails its CRC marks the end of the store; the next append overwrites it.
+//
+// Two index files sit next to the segments and are appended together with them:
+//   heights.idx  one BlockLocation entry per block height (segment, offset, sizes, first tx entry)
+//   txids.idx    one entry per transaction in chain order: leaf hash (32) | height (8) | position (4)
+// Missing or torn index entries are rebuilt from the segments when the store is opened.
+class BlockStore {
+public:
+    static constexpr uint32_t formatVersion = 3; // 2: fixed-point amounts and integer timestamps; 3: state root in the header
+    static constexpr size_t segmentHeaderSize = 16;
+    static constexpr size_t recordHeaderSize = 16 + Block::headerSize + 32;
+    static constexpr size_t heightEntrySize = 32;
+    static constexpr size_t txEntrySize = 44;
+
+    // Where a block lives on disk
+    struct BlockLocation {
+        uint32_t segment; // Segment number
+        uint32_t txCount; // Transactions in the block
+        uint64_t offset; // Offset of the record in the segment
+        uint64_t recordSize; // Size of the whole record
+        uint64_t firstTx; // Index of the block's first entry in txids.idx
+    };
+
+    explicit BlockStore(const std::string& directory, uint64_t maxSegmentBytes = 64ull << 20);
+    ~BlockStore();
+
+    bool open(); // Create the directory if needed, locate the last stored block and check the indexes
+    uint64_t blockCount() const; // Number of blocks in the store
+    const std::string& getDirectory() const;
+
+    // Transaction ids (Merkle leaf hashes) of the block at a height, or null to compute them
+    using LeafIds = std::function<const Hash256*(uint64_t height)>;
+    // Body of a block the chain holds header-only, or null if the caller does not have it
+    using Bodies = std::function<const std::vector<Transaction>*(uint64_t height)>;
+
+    // Write chain[blockCount()..] to the store. Fails if the chain does not extend what is stored.
+    // leafIds supplies the ids for txids.idx that the caller has already hashed, and bodies the
+    // transactions of new blocks whose body is not in chain (bodyLoaded false).
+    bool append(const std::vector<Block>& chain, const LeafIds& leafIds = nullptr, const Bodies& bodies = nullptr);
+    // Flush segments and indexes written since the last sync to stable storage
+    bool sync();
+    bool load(std::vector<Block>& blocks) const; // Decode every stored block, in order
+    bool loadHeaders(std::vector<Block>& blocks) const; // Decode headers only; bodies stay on disk
+    bool readBody(uint64_t height, std::vector<Transaction>& transactions) const; // Load one block's body
+
+    // Call fn(txHash, height, position) for every entry of txids.idx, in chain order
+    bool forEachTransaction(const std::function<void(const Hash256&, uint64_t, uint32_t)>& fn) const;
+
+    // Append the encoded record for one block to out
+    static void encodeBlock(const Block& block, std::vector<uint8_t>& out);
+    // Same, with the body given as transactions[0, count) instead of block.transactions
+    static void encodeBlock(const Block& block, const Transaction* transactions, size_t count,
+                            std::vector<uint8_t>& out);
+    // Decode one record from data; on success append the block to blocks and report its size
+    static bool decodeBlock(const uint8_t* data, size_t available, size_t& recordSize, std::vector<Block>& blocks);
+    // Check the magic, length and CRC of one record without decoding it
+    static bool checkRecord(const uint8_t* data, size_t available, size_t& recordSize);
+
+private:
+    std::string segmentPath(uint32_t segment) const; // File name of a segment
+    std::string indexPath(const char* name) const; // File name of an index
+    // Walk the records of a mapped segment, decoding them into blocks if given. Returns the end
+    // offset of the last intact record and counts the records seen.
+    static size_t scanSegment(const uint8_t* data, size_t size, uint64_t& records, Hash256& lastHash,
+                              std::vector<Block>* blocks);
+    bool openIndexes(); // Load heights.idx, trim torn entries and index any blocks it is missing
+    // Append index entries for the blocks from firstHeight on, whose bodies are newBodies
+    bool writeIndexEntries(const std::vector<BlockLocation>& newLocations,
+                           const std::vector<const std::vector<Transaction>*>& newBodies, size_t firstHeight,
+                           const LeafIds& leafIds);
+    std::shared_ptr<MappedFile> mapSegment(uint32_t segment, uint64_t end) const; // Mapping covering [0, end)
+
+    std::string directory; // Directory holding the segment files
+    uint64_t maxSegmentBytes; // Start a new segment once the current one reaches this size
+    std::vector<uint64_t> segmentFirstHeights; // First block height of each segment, by segment number
+    uint64_t count = 0; // Blocks stored
+    uint64_t lastSegmentEnd = 0; // Offset just past the last intact record of the last segment
+    Hash256 tipHash; // Hash of the last stored block
+    std::vector<BlockLocation> locations; // Contents of heights.idx, one entry per stored block
+    uint32_t firstUnsyncedSegment = UINT32_MAX; // Lowest segment written since the last sync (none if UINT32_MAX)
+
+    mutable std::mutex mutex; // Guards the lazily opened mappings below
+    mutable std::vector<std::shared_ptr<MappedFile>> maps; // Open segment mappings, by segment number
+};
+
+#endif // BLOCKSTORE_H
@@ -3,33 +3,83 @@
 #ifndef BLOCKCHAIN_H
 #define BLOCKCHAIN_H
 
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 #include "Transaction.h"
 #include "MerkleTree.h"
+#include "MerkleAccumulator.h"
+#include "BlockCache.h"
+#include "BloomFilter.h"
+#include "Miner.h"
+#include "StateTree.h"
 using namespace std;
-// Class representing a block in the blockchain
+
+class BlockStore;
+class WriteAheadLog;
+class LogWriter;
+
+// Class representing a block in the blockchain.
+// The block hash is computed once when the block is sealed and cached; the setters reseal.
+// Code that writes header fields directly must call seal() afterwards.
 class Block {
 public:
-    
-    Block(int idx, const string& prevHash, const vector<Transaction>& txs);
-    string hash() const;
+    static constexpr size_t headerSize = 118; // Bytes in the canonical header encoding
+    static constexpr size_t nonceOffset = 110; // The nonce is the last header field
+
+    Block(int idx, const Hash256& prevHash, const vector<Transaction>& txs);
+    // Same, reusing a Merkle tree the caller already built over txs
+    Block(int idx, const Hash256& prevHash, const vector<Transaction>& txs, const MerkleTree& tree);
+    // Same, taking ownership of txs instead of copying them
+    Block(int idx, const Hash256& prevHash, vector<Transaction>&& txs, const MerkleTree& tree);
+    // Same, taking the root and leaf hashes from an accumulator fed exactly txs, in order
+    Block(int idx, const Hash256& prevHash, vector<Transaction>&& txs, const MerkleAccumulator& leaves);
+    // Rebuild a stored block from its encoded header and stored hash, without rehashing anything
+    Block(const uint8_t header[headerSize], const Hash256& storedHash, vector<Transaction>&& txs);
+    const Hash256& hash() const; // Cached block hash
+    Hash256 computeHash() const; // Hash the header from scratch
+    void encodeHeader(uint8_t out[headerSize]) const; // Canonical little-endian header bytes
+    void seal(); // Recompute and cache the block hash
+    static BloomFilter buildBloom(const vector<Transaction>& txs); // Filter over the account names in txs
 
-    // Add these setter methods
-    void setHash(const string& hash);
-    void setTimestamp(const string& timestamp);
+    void setNonce(uint64_t nonce); // Set the nonce and reseal
 
     
     int index;
-    string previousHash;
-    string merkleRoot;
-    string timestamp;
-    int nonce;
-    vector<Transaction> transactions;
+    Hash256 previousHash;
+    Hash256 merkleRoot;
+    Hash256 stateRoot; // Root of the account balance tree after this block's transfers (StateTree)
+    int64_t timestamp; // Seconds since the Unix epoch
+    uint32_t difficulty; // Required leading zero bits of the block hash (0 = no proof of work)
+    uint64_t nonce; // Proof-of-work nonce
+    vector<Transaction> transactions; // Empty until loaded when bodyLoaded is false
+    bool bodyLoaded = true; // False for blocks opened header-only; use Blockchain::getTransactions
+    BloomFilter bloom; // Account names in the block, kept resident with the header (ids go through txIndex)
 
 private:
-    string blockHash; // To store the block's hash directly
+    // Common constructor: seal a new block given its Merkle root
+    Block(int idx, const Hash256& prevHash, vector<Transaction>&& txs, const Hash256& root);
+
+    Hash256 blockHash; // To store the block's hash directly
+};
+
+
+// Where a transaction sits in the chain
+struct TransactionLocation {
+    size_t blockIndex; // Height of the block holding the transaction
+    size_t position; // Index of the transaction within the block
 };
 
+// Side of a transfer an account history query matches
+enum class AccountRole {
+    Sender,
+    Receiver,
+    Either
+};
 
 // Class representing the blockchain
 class Blockchain {
@@ -37,10 +87,152 @@ public:
     vector<Block> chain; // Vector to hold all blocks in the blockchain
 
     Blockchain(); // Constructor to create the genesis block
-    void addBlock(const vector<Transaction>& transactions); // Add a block to the chain
-    bool validateChain() const; // Validate the blockchain
-    void saveToFile(const string& filename) const;   // Save blockchain to file
-    void loadFromFile(const string& filename); 
+    ~Blockchain();
+    // Add a block to the chain, mining it first when a difficulty is set. Returns false if mining was cancelled.
+    bool addBlock(const vector<Transaction>& transactions);
+    // Same, moving the transactions into a block built in place. If mining is cancelled they are moved back.
+    bool addBlock(vector<Transaction>&& transactions);
+    // Same, sealing with the root of an accumulator built over exactly these transactions and
+    // indexing them under leafIds (their MerkleTree::leafHash values, in order), so nothing is
+    // rehashed. Returns false without adding if the leaf count does not match.
+    bool addBlock(vector<Transaction>&& transactions, const MerkleAccumulator& leaves, const Hash256* leafIds);
+    // Reject blocks holding a transfer its sender cannot cover (see StateTree for the rules). Off by
+    // default; balances are tracked and committed in every block's stateRoot either way.
+    void setBalanceCheck(bool enabled);
+    // Account balances after the last block, brought up to date first. Null if a block's
+    // stateRoot does not match its transfers.
+    const StateTree* getState();
+    // Balance of account after the last block and, if proof is given, its proof against that
+    // block's stateRoot. False only if the state is unavailable; absent accounts hold 0.
+    bool getBalance(const string& account, int64_t& balance, StateProof* proof = nullptr);
+    void setDifficulty(uint32_t bits); // Proof-of-work difficulty (leading zero bits) for new blocks
+    uint32_t getDifficulty() const;
+    // Least proof of work a block after genesis must carry: validation and log replay reject a block
+    // whose header declares less, whatever its hash. New blocks are mined to at least this.
+    void setMinimumDifficulty(uint32_t bits);
+    uint32_t getMinimumDifficulty() const;
+    void cancelMining(); // Abort a mining addBlock running on another thread (see Miner::cancel)
+    // Abort the search numbered `search`, even if its addBlock has not reached it yet. Every addBlock
+    // call made while the difficulty is non-zero uses up one number, mined or not.
+    void cancelMining(uint64_t search);
+    uint64_t nextMiningSearch() const; // Number of the search the next mining addBlock runs
+    const MiningResult& getLastMiningResult() const; // Statistics of the most recent mined block
+    bool validateChain(); // Validate the blockchain
+    // Validate in parallel, then check the stateRoot of each block not yet applied to the balance
+    // state by replaying its transfers; on failure report the first bad block
+    bool validateChain(size_t& failedIndex);
+    // Validate only blocks added since the last successful call, then remember the new validated height
+    bool validateNewBlocks(size_t& failedIndex);
+    // Look a transaction up by id (its Merkle leaf hash) in O(1). Identical transactions share an id;
+    // such an id resolves to its first occurrence in the chain, before and after a reload.
+    bool findTransaction(const Hash256& txId, TransactionLocation& location) const;
+    // Call visit for each transaction in which account plays role, in chain order, until visit
+    // returns false. Served from per-account posting lists, so the work is proportional to the
+    // number of results; each block's body is fetched once for all of its matches. After openStore,
+    // an account's first query also scans the stored blocks, reading only the bodies whose Bloom
+    // filter may hold its name. A name that appears nowhere yields no calls and is not interned.
+    // Returns false if a body cannot be read.
+    bool forEachAccountTransaction(const string& account, AccountRole role,
+                                   const function<bool(const TransactionLocation&, const Transaction&)>& visit);
+    // Call visit(height) for each block with from <= timestamp <= to, in timestamp order, until
+    // visit returns false. The first block is found by binary search in a sorted timestamp index.
+    void forEachBlockBetween(int64_t from, int64_t to, const function<bool(size_t)>& visit) const;
+    // Locate a transaction by leaf hash and build its inclusion proof against the block's merkleRoot
+    bool getTransactionProof(const Hash256& txHash, size_t& blockIndex, MerkleProof& proof) const;
+    bool saveToFile(const string& path) const; // Append blocks not yet stored to the block store at path
+    bool loadFromFile(const string& path); // Replace the chain with the contents of the block store at path
+
+    // Replace the chain with the headers in the block store at path. Block bodies stay on disk and
+    // are loaded on demand into a cache limited to cacheBudgetBytes. Blocks found in the store's
+    // write-ahead log are replayed onto the chain and compacted into the store; from then on every
+    // added block is appended to the log.
+    // Memory is not fully bounded by the cache: the transaction id index (txids.idx) is loaded
+    // whole so findTransaction stays a hash lookup, which costs about 50 bytes per stored
+    // transaction. Headers and Bloom filters also stay resident for every block.
+    bool openStore(const string& path, size_t cacheBudgetBytes = 64 << 20);
+    // Make every block added since the last call durable in the write-ahead log, with one write and
+    // one flush for all of them (with a log writer, wait for it instead). Compacts the log once it
+    // grows past logCompactionBytes.
+    bool syncLog();
+    // Hand log writes and flushes to a background thread: addBlock queues each new block's header
+    // for it and only waits when queueDepth blocks are already waiting. The writer encodes the body
+    // straight from chain, so a queued block must not be edited until syncLogAsync reports it
+    // durable. Stays on across openStore. Write errors surface in the next syncLog or syncLogAsync.
+    bool startLogWriter(size_t queueDepth = 16);
+    // Ready, with true if they were all written, once every block added so far is durable
+    future<bool> syncLogAsync();
+    // Fold the log into the open store: save new blocks, flush the store, empty the log and drop
+    // the resident bodies of stored blocks
+    bool compactLog();
+    // Transactions of a block, from memory or (for header-only blocks) the block cache; null on read failure
+    BlockCache::Body getTransactions(size_t height) const;
+    void setCacheBudget(size_t bytes); // Change the block cache's memory budget
+    // Save new blocks to the open store, then drop the resident bodies of every stored block
+    bool releaseStoredBodies();
+
+private:
+    static constexpr uint64_t logCompactionBytes = 64ull << 20; // syncLog compacts a log this large
+
+    struct Posting { // One transaction in an account's history
+        uint32_t height;
+        uint32_t position;
+    };
+
+    struct AccountHistory {
+        vector<Posting> sent; // Transactions with the account as sender, in chain order
+        vector<Posting> received; // Transactions with the account as receiver, in chain order
+        bool scanned = false; // Postings from blocks [0, accountIndexFrom) added
+    };
+
+    bool refuseBlock(); // Return false from a mining addBlock that fails before its search
+    // Mine the block just emplaced if needed, then index it under leafIds and log it
+    bool sealLastBlock(vector<Transaction>& transactions, const Hash256* leafIds);
+    void replayLog(vector<Block>& logged); // Add the logged blocks that extend the chain, stopping at the first that does not
+    // Add a block to txIndex, blockTimes and accountHistory
+    void indexBlock(size_t height, const Hash256* leafIds);
+    void indexTimestamp(size_t height); // Add a block to blockTimes
+    void indexAccounts(size_t height, const vector<Transaction>& transactions); // Append a block's postings
+    // Rebuild blockTimes from the headers of a replaced chain, and accountHistory from its bodies if
+    // they are resident; otherwise each account's postings are found by its first query
+    void resetHistoryIndexes(bool bodiesResident);
+    // Add account's postings in blocks [0, accountIndexFrom) to its accountHistory entry, if it
+    // has any there; the name is not interned otherwise
+    bool scanStoredBlocks(const string& account);
+    bool loadTransactionIndex(const BlockStore& source); // Rebuild txIndex from the store's txids.idx
+    const Hash256* unstoredIds(uint64_t height) const; // Ids of an unstored block, for BlockStore::append
+    // Body of an unstored block held for the log writer, for BlockStore::append and getTransactions
+    const vector<Transaction>* unstoredBody(uint64_t height) const;
+    bool validateBlock(size_t i) const; // Check block i against its predecessor and its transactions
+    bool validateRange(size_t begin, size_t end, size_t& failedIndex) const; // Validate blocks [begin, end)
+    // Apply blocks [stateHeight, end of chain) to state, checking their state roots. On a mismatch
+    // the state is reset and the bad block's height reported through failedIndex.
+    bool catchUpState(size_t* failedIndex = nullptr);
+
+    size_t validatedHeight = 0; // Highest block index confirmed by validateNewBlocks (genesis is trusted)
+    StateTree state; // Balances after blocks [0, stateHeight)
+    size_t stateHeight = 0; // Blocks applied to state; the rest are replayed on demand
+    bool balanceCheck = false; // Reject blocks with unfunded transfers
+    uint32_t difficulty = 0; // Difficulty applied to newly added blocks, never below minimumDifficulty
+    uint32_t minimumDifficulty = 0; // Least difficulty accepted in any block but genesis
+    unique_ptr<Miner> miner = make_unique<Miner>(); // Proof-of-work search engine
+    MiningResult lastMiningResult; // Filled in by addBlock when mining
+    unique_ptr<BlockStore> store; // Store opened by openStore, source of header-only block bodies
+    unique_ptr<BlockCache> cache; // Cache of bodies read from store
+    unique_ptr<WriteAheadLog> log; // Log of blocks added since the store was last compacted
+    unique_ptr<LogWriter> logWriter; // Background writer for log, if started; declared after it so it stops first
+    size_t logWriterDepth = 0; // Queue depth to restart the writer with when another log is opened (0 = none)
+    unordered_map<Hash256, TransactionLocation> txIndex; // Transaction id -> first location, for every block in chain
+    // A block the store has not taken yet. With a log writer running its body lives here, shared
+    // with the writer's job, and the chain keeps only the header.
+    struct UnstoredBlock {
+        vector<Hash256> ids; // Transaction ids, kept until the store has indexed them
+        BlockCache::Body body; // Null while the body is resident in the chain
+    };
+    deque<UnstoredBlock> unstoredBlocks; // Blocks [unstoredHeight, end of chain)
+    size_t unstoredHeight = 0;
+    vector<AccountHistory> accountHistory; // Postings by interned account id
+    size_t accountIndexFrom = 0; // Header-only blocks below this are only in the histories of scanned accounts
+    vector<pair<int64_t, uint32_t>> blockTimes; // (timestamp, height) of every block in chain, sorted
 };
 
 #endif // BLOCKCHAIN_H
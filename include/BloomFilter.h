@@ -0,0 +1,40 @@
+// include/BloomFilter.h
+
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "Hash256.h"
+
+// Fixed-size Bloom filter over byte strings, sized at about 10 bits per item (~1% false positives).
+// Bit positions come from a stable hash, so a filter written to disk means the same thing when read back.
+// An empty filter (no bits) knows nothing and reports every item as possibly present.
+class BloomFilter {
+public:
+    static constexpr uint8_t defaultHashCount = 7;
+
+    BloomFilter() = default;
+    explicit BloomFilter(size_t expectedItems); // Size for expectedItems at the default hash count
+    BloomFilter(std::vector<uint64_t> words, uint8_t hashCount); // Rebuild a stored filter
+
+    void add(const void* data, size_t len);
+    void add(std::string_view item) { add(item.data(), item.size()); }
+    void add(const Hash256& item) { add(item.data(), item.size()); }
+
+    bool mayContain(const void* data, size_t len) const; // False means definitely absent
+    bool mayContain(std::string_view item) const { return mayContain(item.data(), item.size()); }
+    bool mayContain(const Hash256& item) const { return mayContain(item.data(), item.size()); }
+
+    bool empty() const { return bits.empty(); }
+    const std::vector<uint64_t>& words() const { return bits; }
+    uint8_t getHashCount() const { return hashCount; }
+
+private:
+    std::vector<uint64_t> bits; // Filter bits, 64 per word
+    uint8_t hashCount = defaultHashCount; // Bit positions set per item
+};
+
+#endif // BLOOMFILTER_H
@@ -0,0 +1,44 @@
+// include/BodyPool.h
+
+#ifndef BODYPOOL_H
+#define BODYPOOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include "Transaction.h"
+
+// Free list of block body buffers. A body is one contiguous array of fixed-size transactions, so
+// it is already allocated and freed in one go; handing released bodies back here lets the next
+// block reuse that memory instead of paying for a fresh large allocation (and its page faults)
+// every block, and keeps the heap from fragmenting as blocks come and go.
+// Pooled buffers count towards resident memory while idle, so the default budget is small; a bulk
+// job that cycles many bodies (ingest) raises it for its run and restores it afterwards.
+class BodyPool {
+public:
+    static constexpr size_t defaultBudgetBytes = 4 << 20;
+
+    static BodyPool& global(); // Pool shared by block sealing, the log writer and body release
+
+    explicit BodyPool(size_t budgetBytes = defaultBudgetBytes);
+
+    // An empty buffer with room for at least capacity transactions
+    std::vector<Transaction> acquire(size_t capacity);
+    // Keep body's storage for a later acquire; its contents are discarded. Past the budget the
+    // smallest buffers are freed instead.
+    void release(std::vector<Transaction>&& body);
+    size_t pooledBytes() const; // Capacity held by the pool, in bytes
+    // Change the most capacity kept, freeing buffers right away if the pool holds more
+    void setBudget(size_t bytes);
+    size_t getBudget() const;
+
+private:
+    void trimToBudget(); // Free the smallest buffers until bytes fits budgetBytes; mutex must be held
+
+    mutable std::mutex mutex; // Guards the members below
+    std::vector<std::vector<Transaction>> buffers; // Empty buffers, in no particular order
+    size_t budgetBytes; // Most capacity kept at once
+    size_t bytes = 0; // Capacity currently kept
+};
+
+#endif // BODYPOOL_H
@@ -0,0 +1,90 @@
+// include/BoundedQueue.h
+
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+// Blocking FIFO with a fixed capacity, connecting the stages of a pipeline.
+// push() waits while the queue is full, which is how a slow stage holds back the ones before it.
+// close() wakes everyone: pushes then fail, and pops drain what is left before reporting the end.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+    // Wait for room, then add item. Returns false (dropping item) if the queue was closed.
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed) return false;
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Add item only if there is room right now
+    bool tryPush(T& item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed || items.size() >= capacity) return false;
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Wait for an item; empty once the queue is closed and drained
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        return takeFront();
+    }
+
+    // Like pop, but also gives up (returning empty) after timeout; check isDrained() to tell them apart
+    template <typename Rep, typename Period>
+    std::optional<T> popFor(std::chrono::duration<Rep, Period> timeout) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait_for(lock, timeout, [this] { return closed || !items.empty(); });
+        return takeFront();
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+    bool isDrained() const { // Closed and empty: no item will ever come out again
+        std::lock_guard<std::mutex> lock(mutex);
+        return closed && items.empty();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+
+private:
+    std::optional<T> takeFront() { // Caller holds mutex
+        if (items.empty()) return std::nullopt;
+        std::optional<T> item(std::move(items.front()));
+        items.pop_front();
+        notFull.notify_one();
+        return item;
+    }
+
+    const size_t capacity;
+    mutable std::mutex mutex; // Guards items and closed
+    std::condition_variable notEmpty; // Signalled when an item arrives or on close
+    std::condition_variable notFull; // Signalled when an item leaves or on close
+    std::deque<T> items;
+    bool closed = false;
+};
+
+#endif // BOUNDEDQUEUE_H
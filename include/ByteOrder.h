@@ -0,0 +1,39 @@
+// include/ByteOrder.h
+
+#ifndef BYTEORDER_H
+#define BYTEORDER_H
+
+#include <cstdint>
+
+// Little-endian fixed-width integer encoding used by the canonical block header and on-disk formats
+
+inline void putUint16LE(uint8_t* out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+inline void putUint32LE(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+inline void putUint64LE(uint8_t* out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) out[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+inline uint16_t getUint16LE(const uint8_t* in) {
+    return static_cast<uint16_t>(in[0] | in[1] << 8);
+}
+
+inline uint32_t getUint32LE(const uint8_t* in) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; --i) value = value << 8 | in[i];
+    return value;
+}
+
+inline uint64_t getUint64LE(const uint8_t* in) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) value = value << 8 | in[i];
+    return value;
+}
+
+#endif // BYTEORDER_H
@@ -0,0 +1,13 @@
+// include/Crc32.h
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32 (IEEE 802.3 polynomial) used to checksum on-disk records.
+// Pass the previous result as `crc` to checksum data in several pieces.
+uint32_t crc32(const void* data, size_t len, uint32_t crc = 0);
+
+#endif // CRC32_H
@@ -0,0 +1,42 @@
+// include/Hash256.h
+
+#ifndef HASH256_H
+#define HASH256_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+
+// Fixed-size 32-byte SHA-256 digest, kept in binary form everywhere except display and persistence
+struct Hash256 {
+    std::array<uint8_t, 32> bytes{}; // Raw digest bytes (all zero by default)
+
+    uint8_t* data() { return bytes.data(); }
+    const uint8_t* data() const { return bytes.data(); }
+    static constexpr size_t size() { return 32; }
+
+    std::string toHex() const; // 64-character lowercase hex representation
+    static bool fromHex(const std::string& hex, Hash256& out); // Parse 64 hex chars; false on malformed input
+
+    bool operator==(const Hash256& other) const { return bytes == other.bytes; }
+    bool operator!=(const Hash256& other) const { return bytes != other.bytes; }
+    bool operator<(const Hash256& other) const { return bytes < other.bytes; }
+};
+
+// Allow Hash256 as a key in unordered containers. The digest is already uniformly
+// distributed, so the first machine word is a perfectly good hash.
+namespace std {
+template <>
+struct hash<Hash256> {
+    size_t operator()(const Hash256& h) const noexcept {
+        size_t value;
+        memcpy(&value, h.bytes.data(), sizeof(value));
+        return value;
+    }
+};
+} // namespace std
+
+#endif // HASH256_H
@@ -0,0 +1,46 @@
+// include/Ingest.h
+
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <cstddef>
+#include <cstdint>
+#include "Blockchain.h"
+
+// Input encodings understood by ingest()
+enum class IngestFormat {
+    Csv, // One "sender,receiver,amount[,timestamp]" line per transaction; '#' lines are comments
+    Binary // Records of: length (4) | Transaction::encode() bytes, as in the block store
+};
+
+struct IngestOptions {
+    IngestFormat format = IngestFormat::Csv;
+    size_t blockSize = 10000; // Seal a block once it holds this many transactions
+    uint64_t blockIntervalMs = 0; // Also seal once the oldest pending transaction waited this long (0 = off)
+    size_t saveEveryBlocks = 16; // Compact the log into the store and release bodies after this many blocks
+    size_t batchSize = 4096; // Transactions handed between stages at once
+    size_t queueDepth = 8; // Batches buffered between two stages
+    bool checkBalances = false; // Skip transfers their sender cannot fund, and enable the chain's funds check
+};
+
+struct IngestStats {
+    uint64_t transactions = 0; // Transactions added to the chain
+    uint64_t rejected = 0; // Malformed input records skipped
+    uint64_t unfunded = 0; // Transfers skipped by checkBalances
+    uint64_t blocks = 0; // Blocks sealed
+    uint64_t bytesRead = 0; // Input bytes consumed
+    double seconds = 0; // Wall-clock time of the whole run
+};
+
+// Stream transactions from the file descriptor inputFd into blockchain as a four-stage pipeline: a reader thread
+// parses input, a hashing thread computes transaction ids, the calling thread folds the ids into
+// a MerkleAccumulator and seals blocks, and the chain's log writer (Blockchain::startLogWriter)
+// makes them durable in the store's write-ahead log. The chain must have a block store open
+// (Blockchain::openStore). Every saveEveryBlocks blocks the log is compacted into the store and
+// the bodies released, so memory stays bounded however long the input is.
+// Returns false if reading, sealing or persisting fails; stats describe the work done either way.
+// All threads are joined before returning, so the caller may close inputFd afterwards; a failure
+// waiting on idle input returns within about 100 ms.
+bool ingest(Blockchain& blockchain, int inputFd, const IngestOptions& options, IngestStats& stats);
+
+#endif // INGEST_H
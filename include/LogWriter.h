@@ -0,0 +1,55 @@
+// include/LogWriter.h
+
+#ifndef LOGWRITER_H
+#define LOGWRITER_H
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <thread>
+#include "BoundedQueue.h"
+#include "WriteAheadLog.h"
+
+// Background stage that encodes blocks into a write-ahead log and flushes it on its own thread,
+// so the thread sealing blocks never waits for the disk.
+// Blocks are handed over by move through a bounded queue; submit() waits while the queue is full,
+// which holds back a producer that outruns the disk. The writer takes every block already queued
+// before flushing, so a burst of blocks shares one flush. Each submission is acknowledged once its
+// block is durable (or the write failed), through a future or a callback run on the writer thread.
+class LogWriter {
+public:
+    using Callback = std::function<void(bool durable)>;
+    using Body = std::shared_ptr<const std::vector<Transaction>>; // A block body shared with the caller
+
+    explicit LogWriter(WriteAheadLog& log, size_t queueDepth = 16);
+    ~LogWriter(); // Writes and flushes everything queued, then stops the thread
+
+    LogWriter(const LogWriter&) = delete;
+    LogWriter& operator=(const LogWriter&) = delete;
+
+    std::future<bool> submit(Block&& block); // Queue block, waiting for room
+    void submit(Block&& block, Callback onDurable); // Same, acknowledging through onDurable (may be empty)
+    // Same for a header-only block whose body the caller keeps serving reads from: the job holds a
+    // reference to body, so it stays alive until written however the caller's copy is dropped
+    void submit(Block&& block, Body body, Callback onDurable);
+    // Queue block only if there is room right now; otherwise leave it with the caller and return false
+    bool trySubmit(Block& block, Callback onDurable);
+    std::future<bool> flush(); // Ready once every block submitted before it is durable
+
+private:
+    struct Job {
+        std::optional<Block> block; // Empty for a flush request
+        Callback done;
+        Body body = nullptr; // Body shared with the caller, if not block's own
+    };
+
+    void run(); // Writer thread: append and flush queued blocks group by group
+
+    WriteAheadLog& log;
+    BoundedQueue<Job> queue;
+    std::thread writer;
+};
+
+#endif // LOGWRITER_H
@@ -0,0 +1,33 @@
+// include/MappedFile.h
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file. Uses mmap on POSIX systems; elsewhere the file is read into memory.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path); // Map the file; false if it cannot be opened
+    void close(); // Release the mapping
+
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const uint8_t* bytes = nullptr; // Start of the mapped (or buffered) contents
+    size_t length = 0; // File size in bytes
+    bool mapped = false; // True if bytes came from mmap and must be unmapped
+    std::vector<uint8_t> buffer; // Fallback storage when mmap is unavailable
+};
+
+#endif // MAPPEDFILE_H
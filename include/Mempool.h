@@ -0,0 +1,61 @@
+// include/Mempool.h
+
+#ifndef MEMPOOL_H
+#define MEMPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+#include "Hash256.h"
+#include "Transaction.h"
+
+// Pool of pending transactions that many threads can add to at once.
+// Transactions are spread over independently locked shards by id, so producers only contend
+// when their transactions land in the same shard. A transaction whose id (Merkle leaf hash)
+// is already pending is rejected. Batches come out in the order transactions were accepted.
+class Mempool {
+public:
+    static constexpr size_t shardCount = 64;
+
+    Mempool() = default;
+    Mempool(const Mempool&) = delete;
+    Mempool& operator=(const Mempool&) = delete;
+
+    // Add a transaction; returns false if one with the same id is already pending
+    bool add(const Transaction& transaction);
+    bool add(Transaction&& transaction);
+    // Remove and return up to maxTx of the oldest pending transactions, ready to move into addBlock
+    std::vector<Transaction> drainBatch(size_t maxTx);
+    std::vector<Transaction> snapshot() const; // Copy of the pending transactions, oldest first
+    bool contains(const Hash256& txId) const; // Whether a transaction with this id is pending
+    size_t size() const; // Number of pending transactions
+    bool empty() const;
+
+private:
+    struct Entry {
+        uint64_t sequence; // Acceptance order across all shards
+        Hash256 id;
+        Transaction transaction;
+    };
+
+    // Each shard sits on its own cache line so producers in different shards do not share one
+    struct alignas(64) Shard {
+        mutable std::mutex mutex; // Guards everything below
+        std::deque<Entry> entries; // Pending transactions, in increasing sequence order
+        std::unordered_set<Hash256> ids; // Ids of the entries, for de-duplication
+    };
+
+    bool insert(const Hash256& id, Transaction&& transaction); // Add to the shard owning id
+    Shard& shardFor(const Hash256& id);
+    const Shard& shardFor(const Hash256& id) const;
+
+    Shard shards[shardCount];
+    std::atomic<uint64_t> nextSequence{0}; // Sequence number for the next accepted transaction
+    std::atomic<size_t> pending{0}; // Number of pending transactions
+};
+
+#endif // MEMPOOL_H
@@ -0,0 +1,31 @@
+// include/MerkleAccumulator.h
+
+#ifndef MERKLEACCUMULATOR_H
+#define MERKLEACCUMULATOR_H
+
+#include <cstddef>
+#include <vector>
+#include "Hash256.h"
+#include "Transaction.h"
+
+// Append-only Merkle root over a growing list of transactions.
+// Only the frontier is kept: one complete subtree root per set bit of the leaf count, so
+// append and getRootHash are both O(log n). Folding the frontier from the smallest subtree
+// up gives exactly MerkleTree::getRootHash() for the same transactions, because MerkleTree
+// carries odd nodes up unchanged. The leaves themselves are not kept, so memory is O(log n);
+// callers that need the ids as well (the transaction index) hold on to them.
+class MerkleAccumulator {
+public:
+    void append(const Transaction& transaction); // Add the next transaction
+    void appendLeaf(const Hash256& leafHash); // Add the next leaf by its hash (MerkleTree::leafHash)
+    Hash256 getRootHash() const; // Root of the tree over every leaf so far (all zero when empty)
+    size_t leafCount() const;
+    void clear(); // Forget every leaf
+
+private:
+    std::vector<Hash256> frontier; // frontier[k] is the root of a complete subtree of 2^k leaves,
+                                   // meaningful when bit k of leafCount() is set
+    size_t count = 0; // Leaves appended so far
+};
+
+#endif // MERKLEACCUMULATOR_H
@@ -3,30 +3,55 @@
 #ifndef MERKLETREE_H
 #define MERKLETREE_H
 
-#include <memory>
-#include <string>
+#include <atomic>
+#include <cstddef>
 #include <vector>
+#include "Hash256.h"
 #include "Transaction.h"
 
-// Class representing a node in the Merkle tree
-class MerkleNode {
-public:
-    std::string hash; // Hash of the node
-    std::shared_ptr<MerkleNode> left; // Left child
-    std::shared_ptr<MerkleNode> right; // Right child
-
-    MerkleNode(const std::string& hash);
+// One step of an inclusion proof: the sibling digest and which side it sits on
+struct MerkleProofStep {
+    Hash256 sibling; // Hash of the sibling node on this level
+    bool siblingOnLeft; // True if the sibling is the left child (hash sibling + current)
 };
 
-// Class representing the Merkle tree
+// Sibling path from a leaf up to the root. Levels where the node is carried up
+// unpaired contribute no step.
+using MerkleProof = std::vector<MerkleProofStep>;
+
+// Class representing the Merkle tree.
+// All levels live back to back in one flat buffer, leaves first and the root last.
+// Within a level, the children of position p are 2p and 2p + 1 on the level below,
+// and an odd last node is carried up to the next level unchanged.
+// Trees with at least getParallelThreshold() leaves are hashed on the shared ThreadPool;
+// the root is identical either way.
 class MerkleTree {
 public:
-    std::shared_ptr<MerkleNode> root; // Root node of the Merkle tree
-
     MerkleTree(const std::vector<Transaction>& transactions);
-    std::shared_ptr<MerkleNode> buildTree(const std::vector<Transaction>& transactions);
-    std::string hash(const std::string& data) const; // Method to compute hash
-    std::string getRootHash() const; // Get the root hash of the tree
+    void buildTree(const std::vector<Transaction>& transactions); // (Re)build the tree from transactions
+    static Hash256 leafHash(const Transaction& transaction); // Hash of the transaction's canonical encoding
+    // Leaf hashes of count transactions into out, batched through the multi-buffer kernel
+    static void leafHashes(const Transaction* transactions, size_t count, Hash256* out);
+    static Hash256 hashPair(const Hash256& left, const Hash256& right); // Hash of two concatenated child digests
+    Hash256 getRootHash() const; // Get the root hash of the tree (all zero for an empty tree)
+
+    size_t leafCount() const; // Number of leaves (transactions)
+    size_t levelCount() const; // Number of levels, including leaves and root
+    size_t levelSize(size_t level) const; // Number of nodes on a level (0 = leaves)
+    const Hash256& node(size_t level, size_t position) const; // Node hash by level and position
+    const Hash256* leafData() const; // The leaf hashes in order, leafCount() of them
+
+    static void setParallelThreshold(size_t txCount); // Minimum leaf count for a parallel build
+    static size_t getParallelThreshold();
+
+    MerkleProof getProof(size_t txIndex) const; // Sibling path for a leaf (empty if out of range)
+    static bool verifyProof(const Hash256& leafHash, const MerkleProof& proof, const Hash256& root);
+
+private:
+    std::vector<Hash256> nodes; // Every level stored contiguously, leaves first
+    std::vector<size_t> levelOffsets; // Start of each level in nodes, plus a trailing end offset
+
+    static std::atomic<size_t> parallelThreshold; // Leaf count from which builds go parallel
 };
 
 #endif // MERKLETREE_H
@@ -0,0 +1,52 @@
+// include/Miner.h
+
+#ifndef MINER_H
+#define MINER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "Hash256.h"
+
+class Block;
+
+// Outcome of a proof-of-work search
+struct MiningResult {
+    bool found = false; // False if the search was cancelled
+    uint64_t nonce = 0; // Winning nonce (valid when found)
+    uint64_t attempts = 0; // Header hashes tried across all threads
+    double seconds = 0; // Wall-clock search time
+    double hashesPerSecond = 0; // attempts / seconds
+};
+
+// Multi-threaded proof-of-work search over Block::nonce.
+// The header bytes before the nonce never change during a search, so their SHA-256 state is
+// computed once and every attempt only hashes the final chunk holding the nonce.
+// Searches are numbered from 1, one mine() or skip() at a time, so a cancel can name the search
+// it is meant for: a cancel sent just before a search starts still stops it, and a cancel sent
+// when no search is running never reaches a later one.
+class Miner {
+public:
+    explicit Miner(size_t threadCount = 0); // 0 uses one thread per hardware thread
+
+    // Search for a nonce giving block.difficulty leading zero bits. On success the block's nonce
+    // is set and the block is resealed. Blocks until found or cancelled.
+    MiningResult mine(Block& block);
+    void skip(); // Use up the next search number without searching, for a block that was never mined
+    uint64_t nextSearch() const; // Number the next mine() call will run as
+    // Stop the search in progress, if any (callable from any thread, and from a signal handler)
+    void cancel();
+    // Stop search number `search` whether it is running or yet to start; other searches are unaffected.
+    // Also callable from a signal handler.
+    void cancel(uint64_t search);
+
+    static bool meetsDifficulty(const Hash256& hash, uint32_t difficulty); // Leading zero bit check
+
+private:
+    size_t threadCount; // Search threads per mine() call
+    std::atomic<uint64_t> searches{0}; // Searches started or skipped so far
+    std::atomic<uint64_t> cancelledThrough{0}; // Searches numbered up to this one are cancelled
+    std::atomic<bool> searching{false}; // A mine() call is running search number `searches`
+};
+
+#endif // MINER_H
@@ -0,0 +1,121 @@
+// include/StateTree.h
+
+#ifndef STATETREE_H
+#define STATETREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Hash256.h"
+#include "Transaction.h"
+
+// Path from the state root towards one account's key, proving its balance or its absence
+struct StateProof {
+    std::vector<Hash256> siblings; // Sibling hash at each depth, from the root down
+    bool endsAtLeaf = false; // The path ends at a leaf (else at an empty subtree)
+    Hash256 leafKey; // Key of that leaf; a different key proves the account is absent
+    int64_t leafBalance = 0; // Balance stored in that leaf
+};
+
+// Sparse Merkle tree of account balances, keyed by the SHA-256 of the account name.
+//
+// Conceptually a binary tree over all 2^256 keys, following the key's bits from the most
+// significant. Only occupied paths are stored: a subtree holding a single account is
+// represented by that leaf alone, so paths are about log2(accounts) deep.
+//   empty subtree:  all-zero hash
+//   one account:    SHA-256(0x00 | key (32) | balance (8, little-endian))
+//   otherwise:      SHA-256(0x01 | left hash | right hash)
+// Accounts with a zero balance have no leaf, so the root depends only on the non-zero balances,
+// not on the order or grouping of the transfers that produced them.
+//
+// Transfers debit the sender and credit the receiver. The issuer account mints: its transfers
+// credit the receiver without debiting anyone, and funds sent to it leave circulation.
+class StateTree {
+public:
+    static constexpr std::string_view issuer = "coinbase";
+
+    StateTree();
+
+    static Hash256 accountKey(std::string_view account); // SHA-256 of the name
+    const Hash256& rootHash() const; // Root over every balance applied so far
+    size_t accountCount() const;
+    bool balance(const Hash256& key, int64_t& value) const; // False if the account's balance is zero
+    int64_t balanceOf(uint32_t accountId) const; // Balance by interned id; 0 for unknown accounts
+
+    // Apply transfers in order, then rehash every changed path once. With checkFunds, a transfer
+    // of a negative amount or more than its sender holds is rejected; a transfer that would
+    // overflow a balance always is. On rejection nothing is applied and the index of the
+    // offending transfer is reported through failed.
+    bool apply(const std::vector<Transaction>& transactions, bool checkFunds, size_t* failed = nullptr);
+    void undo(); // Revert the last successful apply
+    void clear();
+
+    StateProof prove(const Hash256& key) const;
+    // Check proof against root. On success report whether key is present and, if so, its balance.
+    static bool verify(const Hash256& root, const Hash256& key, const StateProof& proof, bool& present,
+                       int64_t& balance);
+
+private:
+    static constexpr uint32_t none = UINT32_MAX;
+
+    struct Node { // Shape only, so the walk down a path touches few cache lines
+        uint32_t children[2] = {none, none}; // Internal nodes only
+        bool leaf = false;
+        bool dirty = true; // Hash needs recomputing
+    };
+
+    struct Change { // Journal entry for undo: an account's balance before the last apply
+        Hash256 key;
+        int64_t balance; // 0: the account had no leaf
+    };
+
+    const Hash256& keyOf(uint32_t accountId) const; // Cached accountKey of an interned account
+    uint32_t newNode();
+    void set(const Hash256& key, int64_t value); // Insert or update a leaf, marking its path dirty
+    void erase(const Hash256& key); // Remove a leaf, folding away internal nodes left with one leaf
+    void rehash(); // Recompute dirty nodes, deepest first, in batches
+
+    // Node storage, one entry per node in each vector; freed slots are listed in freeNodes
+    std::vector<Node> nodes;
+    std::vector<Hash256> hashes; // Subtree hashes, valid unless dirty
+    std::vector<Hash256> keys; // Account key of each leaf
+    std::vector<int64_t> balances; // Balance of each leaf
+    std::vector<uint32_t> freeNodes;
+    uint32_t rootNode = none;
+    Hash256 root; // Cached root hash
+    std::unordered_map<Hash256, uint32_t> leaves; // Account key -> leaf node
+    std::vector<Change> journal; // Balances overwritten by the last apply
+    mutable std::vector<Hash256> keysById; // Account keys by interned id
+    mutable std::vector<bool> keyKnown; // Which entries of keysById are filled in
+    uint32_t issuerId; // Interned id of the issuer account
+
+    friend class PendingBalances;
+};
+
+// Balances of a block still being assembled, layered over a StateTree. A producer offers each
+// transfer before adding it to the block, so a block it seals never fails the funds check.
+class PendingBalances {
+public:
+    explicit PendingBalances(const StateTree& base, bool checkFunds = true);
+
+    bool tryApply(const Transaction& transaction); // Record the transfer if StateTree's rules allow it
+    void clear(); // Forget pending transfers, once their block has been applied to the base tree
+
+private:
+    struct Entry {
+        int64_t before; // Balance in the base tree
+        int64_t after; // Balance after the pending transfers
+    };
+
+    int64_t& balance(uint32_t accountId); // Pending balance, starting from the base tree's
+
+    const StateTree& base;
+    const bool checkFunds;
+    std::unordered_map<uint32_t, Entry> balances; // Accounts touched by pending transfers
+
+    friend class StateTree;
+};
+
+#endif // STATETREE_H
@@ -0,0 +1,42 @@
+// include/ThreadPool.h
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads shared by the library's parallel code paths
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount); // Start threadCount workers (0 runs everything on the caller)
+    ~ThreadPool(); // Finish queued tasks and join the workers
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    static ThreadPool& shared(); // Library-wide pool with one worker per extra hardware thread
+
+    size_t size() const; // Number of worker threads
+    void submit(std::function<void()> task); // Queue a task for the workers
+
+    // Split [0, count) into chunks of `grain` items and run fn(begin, end) on each, using the
+    // workers and the calling thread. Returns once every chunk has run. Safe to call from a task.
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+private:
+    void workerLoop(); // Body of each worker thread
+
+    std::vector<std::thread> workers; // Worker threads
+    std::deque<std::function<void()>> tasks; // Pending tasks
+    std::mutex mutex; // Guards tasks and stopping
+    std::condition_variable wake; // Signalled when a task is queued or on shutdown
+    bool stopping = false; // Set by the destructor
+};
+
+#endif // THREADPOOL_H
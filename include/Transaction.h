@@ -3,24 +3,67 @@
 #ifndef TRANSACTION_H
 #define TRANSACTION_H
 
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
 #include <string>
+#include <string_view>
+#include "ByteOrder.h"
 
-// Class representing a financial transaction
+// Class representing a financial transaction.
+// Kept as a small trivially copyable value: accounts are ids interned in AccountRegistry::global(),
+// the amount is fixed point and the timestamp is an integer, so nothing here allocates.
 class Transaction {
 public:
-    std::string sender;       // Sender's name
-    std::string receiver;     // Receiver's name
-    float amount;             // Amount transferred
-    std::string timestamp;    // Time of transaction
+    static constexpr int64_t amountScale = 100000000; // Amount units per whole coin (8 decimal places)
 
-    // Constructor to initialize transaction with sender, receiver, and amount
-    Transaction(const std::string& sender, const std::string& receiver, float amount);
+    uint32_t senderId;        // Sender's interned account id
+    uint32_t receiverId;      // Receiver's interned account id
+    int64_t amount;           // Amount transferred, in 1/amountScale units
+    int64_t timestamp;        // Time of transaction, seconds since the Unix epoch
 
-    // Method to serialize transaction details
-    std::string serialize() const;
+    // Constructor to initialize transaction with sender, receiver, and amount, stamped with the current time
+    Transaction(std::string_view sender, std::string_view receiver, int64_t amount);
+    // Constructor for a transaction with a known timestamp, e.g. read back from storage
+    Transaction(std::string_view sender, std::string_view receiver, int64_t amount, int64_t timestamp);
+    // Constructor from already interned account ids
+    Transaction(uint32_t senderId, uint32_t receiverId, int64_t amount, int64_t timestamp);
+
+    std::string_view sender() const; // Sender's name (valid for the life of the program)
+    std::string_view receiver() const; // Receiver's name
+
+    // Canonical encoding, which is what the transaction id (Merkle leaf) hashes:
+    // sender length (4) | sender | receiver length (4) | receiver | amount (8) | timestamp (8), little-endian.
+    // The length prefixes keep different field splits (e.g. "ab"+"c" and "a"+"bc") distinct.
+    size_t encodedSize() const;
+    uint8_t* encode(uint8_t* out) const; // Write encodedSize() bytes to out; returns the end
+    // Hand the canonical encoding to write(const void* data, size_t len) piece by piece, without a buffer
+    template <typename Write>
+    void writeCanonical(Write&& write) const;
+    // Parse a canonical encoding that spans exactly size bytes; empty if it is malformed
+    static std::optional<Transaction> decode(const uint8_t* data, size_t size);
 
     // Equality operator to allow comparison between transactions
     bool operator==(const Transaction& other) const;
+
+    // Parse a decimal amount such as "12.5" exactly into units; false if malformed or out of range
+    static bool parseAmount(std::string_view text, int64_t& units);
+    static std::string formatAmount(int64_t units); // Decimal form of an amount, without trailing zeros
 };
 
+template <typename Write>
+void Transaction::writeCanonical(Write&& write) const {
+    uint8_t field[8];
+    for (std::string_view name : {sender(), receiver()}) {
+        putUint32LE(field, static_cast<uint32_t>(name.size()));
+        write(field, 4);
+        write(name.data(), name.size());
+    }
+    putUint64LE(field, static_cast<uint64_t>(amount));
+    write(field, 8);
+    putUint64LE(field, static_cast<uint64_t>(timestamp));
+    write(field, 8);
+}
+
 #endif // TRANSACTION_H
@@ -0,0 +1,68 @@
+// include/WriteAheadLog.h
+
+#ifndef WRITEAHEADLOG_H
+#define WRITEAHEADLOG_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Blockchain.h"
+
+// Append-only log of sealed blocks that have not been compacted into the block store yet.
+//
+// File:  magic "BWAL" | format version (4) | block records...
+// Each record is encoded exactly as in a store segment (BlockStore::encodeBlock), so it carries
+// its own length and CRC-32. Replay stops at the first record that is cut short or fails its CRC;
+// that torn tail is cut off when the log is opened.
+//
+// append() only buffers a record in memory. sync() writes everything buffered with one write and
+// one fdatasync, so blocks appended together share the cost of one flush (group commit). Several
+// threads may call sync() at once: one of them writes for the whole group while the others wait.
+// Where fdatasync is unavailable, sync() only flushes to the operating system.
+class WriteAheadLog {
+public:
+    static constexpr uint32_t formatVersion = 2; // 2: state root in the block header
+    static constexpr size_t headerSize = 8;
+
+    explicit WriteAheadLog(const std::string& path);
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Open or create the log and decode its intact records into blocks, in log order
+    bool open(std::vector<Block>& blocks);
+    // Buffer a record for block (its body must be resident); returns the record's sequence number
+    uint64_t append(const Block& block);
+    uint64_t append(const Block& block, const Transaction* transactions, size_t count); // Body given separately
+    bool sync(uint64_t sequence); // Wait until the record with this sequence number is durable
+    bool sync(); // Make every appended record durable
+    // Empty the log. Only call once every appended block is durable in the block store.
+    bool reset();
+    uint64_t size() const; // Bytes in the log, including records not written yet
+    const std::string& getPath() const;
+
+private:
+    bool writeHeader(); // Start an empty log file
+    bool truncate(uint64_t length); // Cut the file to length bytes
+    void close();
+
+    std::string path; // Location of the log file
+    std::FILE* file = nullptr; // Open log file
+
+    mutable std::mutex mutex; // Guards the members below
+    std::condition_variable flushed; // Signalled when a group write finishes
+    std::vector<uint8_t> pending; // Records appended but not written yet
+    std::vector<uint8_t> writing; // Records the current group write is flushing
+    uint64_t appended = 0; // Sequence number of the last appended record
+    uint64_t durable = 0; // Sequence number of the last record known to be on stable storage
+    uint64_t fileSize = 0; // Bytes written to the file
+    bool flushing = false; // A thread is writing a group
+    bool failed = false; // A write failed; the file's tail is unknown, so the log refuses further work
+};
+
+#endif // WRITEAHEADLOG_H
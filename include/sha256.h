@@ -98,6 +98,65 @@ void sha_256_write(struct Sha_256 *sha_256, const void *data, size_t len);
  */
 uint8_t *sha_256_close(struct Sha_256 *sha_256);
 
+/*
+ * @brief Copy an on-going SHA-256 streaming calculation, so that it can be continued from the same point twice.
+ * @param dst The structure to copy into.
+ * @param src A pointer to a previously initialized SHA-256 structure.
+ * @param hash Hash array where the copy's result will be delivered.
+ *
+ * @note This is how a "midstate" is reused: stream the common prefix once, then clone the structure for every
+ * different suffix. Plain struct assignment does not work, since the structure points into its own chunk buffer.
+ */
+void sha_256_clone(struct Sha_256 *dst, const struct Sha_256 *src, uint8_t hash[SIZE_OF_SHA_256_HASH]);
+
+/*
+ * @brief Report whether the CPU supports the hardware (SHA-NI) compression function.
+ * @return Non-zero if the SHA extensions are available.
+ *
+ * @note When they are, calc_sha_256 and the streaming API use them automatically from program start.
+ */
+int sha_256_hw_available(void);
+
+/*
+ * @brief Select the hardware or portable compression function for all subsequent calculations.
+ * @param enable Non-zero to use SHA-NI when available, zero to force the portable code.
+ * @return Non-zero if the hardware path is now in use.
+ *
+ * @note Intended for testing and benchmarking. Do not call it while other threads are hashing.
+ */
+int sha_256_use_hw(int enable);
+
+/*
+ * @brief Check both compression functions against the NIST test vectors and against each other.
+ * @return The number of failed checks; zero means every check passed.
+ *
+ * @note Compares the hardware and portable paths on pseudo-random inputs of every length up to four chunks when
+ * SHA-NI is available. The previously selected path is restored afterwards. Not thread-safe, like sha_256_use_hw.
+ */
+int sha_256_self_test(void);
+
+/*
+ * @brief Hash several independent messages in one call.
+ * @param hashes Output array of n * SIZE_OF_SHA_256_HASH bytes; the digest of message i starts at offset
+ * i * SIZE_OF_SHA_256_HASH.
+ * @param inputs Array of n pointers to the messages.
+ * @param lens Array of n message lengths, in byte.
+ * @param n Number of messages.
+ *
+ * @note Messages are hashed side by side in SIMD lanes (8 with AVX2, 16 with AVX-512) when the CPU supports it, and
+ * with calc_sha_256 otherwise. The results are identical to calling calc_sha_256 on each message.
+ *
+ * @note Messages of similar length make best use of the lanes, since a group runs for as many chunks as its longest
+ * message.
+ */
+void calc_sha_256_many(uint8_t *hashes, const void *const inputs[], const size_t lens[], size_t n);
+
+/*
+ * @brief Report how many messages calc_sha_256_many hashes in parallel on this CPU.
+ * @return 16 for AVX-512, 8 for AVX2, 1 when only the scalar code is available.
+ */
+int sha_256_many_lanes(void);
+
 #ifdef __cplusplus
 }
 #endif
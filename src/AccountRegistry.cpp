@@ -0,0 +1,71 @@
+// src/AccountRegistry.cpp
+
+#include "AccountRegistry.h"
+#include <mutex>
+
+using namespace std;
+
+AccountRegistry& AccountRegistry::global() {
+    static AccountRegistry registry;
+    return registry;
+}
+
+// Position of the highest set bit of a non-zero value
+static unsigned highBit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#else
+    unsigned bit = 0;
+    while (value >>= 1) ++bit;
+    return bit;
+#endif
+}
+
+// Chunks double in size, so id + 1024 has its highest bit at position firstChunkBits + chunk
+string& AccountRegistry::slot(uint32_t id) const {
+    const uint64_t biased = uint64_t(id) + (1u << firstChunkBits);
+    const unsigned bit = highBit(biased);
+    return chunks[bit - firstChunkBits][biased - (uint64_t(1) << bit)];
+}
+
+// Known names only take the shared lock; the exclusive lock is rechecked before adding
+uint32_t AccountRegistry::intern(string_view name) {
+    {
+        shared_lock<shared_mutex> lock(mutex);
+        auto found = ids.find(name);
+        if (found != ids.end()) return found->second;
+    }
+    unique_lock<shared_mutex> lock(mutex);
+    auto found = ids.find(name);
+    if (found != ids.end()) return found->second;
+    const uint32_t id = count.load(memory_order_relaxed);
+    const uint64_t biased = uint64_t(id) + (1u << firstChunkBits);
+    if ((biased & (biased - 1)) == 0) { // First id of a chunk
+        const unsigned bit = highBit(biased);
+        chunks[bit - firstChunkBits] = make_unique<string[]>(size_t(1) << bit);
+    }
+    string& stored = slot(id);
+    stored = name;
+    ids.emplace(stored, id);
+    count.store(id + 1, memory_order_release); // name() may read the slot from here on
+    return id;
+}
+
+bool AccountRegistry::find(string_view name, uint32_t& id) const {
+    shared_lock<shared_mutex> lock(mutex);
+    auto found = ids.find(name);
+    if (found == ids.end()) return false;
+    id = found->second;
+    return true;
+}
+
+// The acquire pairs with intern's release, so the slot is fully written even if the id reached
+// this thread without any other synchronization
+string_view AccountRegistry::name(uint32_t id) const {
+    count.load(memory_order_acquire);
+    return slot(id);
+}
+
+size_t AccountRegistry::size() const {
+    return count.load(memory_order_acquire);
+}
@@ -0,0 +1,71 @@
+// src/BlockCache.cpp
+
+#include "BlockCache.h"
+#include "BodyPool.h"
+
+using namespace std;
+
+BlockCache::BlockCache(size_t budgetBytes) : budget(budgetBytes) {}
+
+// The body is read without holding the lock, so a slow load does not block hits on other blocks
+BlockCache::Body BlockCache::get(uint64_t height, const function<bool(vector<Transaction>&)>& load) {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        auto found = entries.find(height);
+        if (found != entries.end()) {
+            recency.splice(recency.begin(), recency, found->second.position);
+            return found->second.body;
+        }
+    }
+
+    // Evicted bodies go back to the pool once the last reader lets go of them
+    shared_ptr<vector<Transaction>> transactions(new vector<Transaction>(), [](vector<Transaction>* body) {
+        BodyPool::global().release(move(*body));
+        delete body;
+    });
+    if (!load(*transactions)) return nullptr;
+    const size_t bytes = estimateBytes(*transactions);
+
+    lock_guard<std::mutex> lock(mutex);
+    auto found = entries.find(height);
+    if (found != entries.end()) return found->second.body; // Another thread loaded it meanwhile
+    recency.push_front(height);
+    Body body = move(transactions);
+    entries.emplace(height, Entry{body, bytes, recency.begin()});
+    used += bytes;
+    evict();
+    return body;
+}
+
+void BlockCache::setBudget(size_t budgetBytes) {
+    lock_guard<std::mutex> lock(mutex);
+    budget = budgetBytes;
+    evict();
+}
+
+size_t BlockCache::residentBytes() const {
+    lock_guard<std::mutex> lock(mutex);
+    return used;
+}
+
+void BlockCache::clear() {
+    lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    recency.clear();
+    used = 0;
+}
+
+size_t BlockCache::estimateBytes(const vector<Transaction>& transactions) {
+    // Transactions own no heap memory; account names live in the shared registry
+    return sizeof(vector<Transaction>) + transactions.capacity() * sizeof(Transaction);
+}
+
+// The most recent body always stays, even if it alone exceeds the budget
+void BlockCache::evict() {
+    while (used > budget && recency.size() > 1) {
+        auto oldest = entries.find(recency.back());
+        used -= oldest->second.bytes;
+        entries.erase(oldest);
+        recency.pop_back();
+    }
+}
@@ -0,0 +1,497 @@
+// src/BlockStore.cpp
+
+#include "BlockStore.h"
+#include "BodyPool.h"
+#include "ByteOrder.h"
+#include "Crc32.h"
+#include "MappedFile.h"
+#include "MerkleTree.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define BLOCKSTORE_HAVE_FSYNC 1
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static const uint8_t segmentMagic[4] = {'B', 'C', 'S', 'G'};
+static const uint8_t recordMagic[4] = {'B', 'L', 'K', '2'};
+
+// Read the Bloom filter section at the start of a record's body; false if it is malformed
+static bool getBloom(const uint8_t* record, uint32_t bodyLength, BloomFilter& filter, size_t& sectionSize) {
+    if (bodyLength < 8) return false;
+    const uint8_t* section = record + BlockStore::recordHeaderSize;
+    const uint32_t wordCount = getUint32LE(section);
+    sectionSize = 8 + static_cast<size_t>(wordCount) * 8;
+    if (sectionSize > bodyLength) return false;
+    vector<uint64_t> words(wordCount);
+    for (uint32_t i = 0; i < wordCount; ++i) {
+        words[i] = getUint64LE(section + 8 + 8 * i);
+    }
+    filter = BloomFilter(move(words), section[4]);
+    return true;
+}
+
+// Flush a file, or a directory's entries, to stable storage; nothing to do where fsync is unavailable
+static bool syncPath(const string& path) {
+#ifdef BLOCKSTORE_HAVE_FSYNC
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    const bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#else
+    (void)path;
+    return true;
+#endif
+}
+
+BlockStore::BlockStore(const string& directory, uint64_t maxSegmentBytes)
+    : directory(directory), maxSegmentBytes(maxSegmentBytes) {}
+
+BlockStore::~BlockStore() = default;
+
+const string& BlockStore::getDirectory() const {
+    return directory;
+}
+
+string BlockStore::indexPath(const char* name) const {
+    return (fs::path(directory) / name).string();
+}
+
+string BlockStore::segmentPath(uint32_t segment) const {
+    char name[32];
+    snprintf(name, sizeof(name), "segment-%06u.dat", segment);
+    return (fs::path(directory) / name).string();
+}
+
+// Find every segment and scan only the last one: earlier segments are full, and their block
+// counts follow from the first height stored in the next segment's header
+bool BlockStore::open() {
+    error_code ec;
+    fs::create_directories(directory, ec);
+    if (!fs::is_directory(directory, ec)) return false;
+
+    segmentFirstHeights.clear();
+    count = 0;
+    lastSegmentEnd = 0;
+    tipHash = Hash256();
+    firstUnsyncedSegment = UINT32_MAX;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        maps.clear();
+    }
+
+    for (uint32_t segment = 0;; ++segment) {
+        MappedFile file;
+        if (!file.open(segmentPath(segment))) break;
+        if (file.size() < segmentHeaderSize) break; // Torn segment header: the end of the store
+        if (memcmp(file.data(), segmentMagic, 4) != 0 || getUint32LE(file.data() + 4) != formatVersion) {
+            return false; // Not a segment this code understands; refuse rather than overwrite it
+        }
+        segmentFirstHeights.push_back(getUint64LE(file.data() + 8));
+    }
+    if (segmentFirstHeights.empty()) return openIndexes();
+
+    MappedFile last;
+    last.open(segmentPath(static_cast<uint32_t>(segmentFirstHeights.size() - 1)));
+    uint64_t records = 0;
+    lastSegmentEnd = scanSegment(last.data(), last.size(), records, tipHash, nullptr);
+    count = segmentFirstHeights.back() + records;
+    if (records == 0 && segmentFirstHeights.size() > 1) {
+        // The last segment is empty, so the tip lives at the end of the previous one
+        MappedFile previous;
+        previous.open(segmentPath(static_cast<uint32_t>(segmentFirstHeights.size() - 2)));
+        uint64_t previousRecords = 0;
+        scanSegment(previous.data(), previous.size(), previousRecords, tipHash, nullptr);
+    }
+    return openIndexes();
+}
+
+// heights.idx entry: segment (4) | transaction count (4) | offset (8) | record size (8) | first tx entry (8)
+bool BlockStore::openIndexes() {
+    locations.clear();
+    MappedFile heights;
+    if (heights.open(indexPath("heights.idx"))) {
+        const uint64_t entries = min<uint64_t>(heights.size() / heightEntrySize, count);
+        for (uint64_t i = 0; i < entries; ++i) {
+            const uint8_t* entry = heights.data() + i * heightEntrySize;
+            locations.push_back({getUint32LE(entry), getUint32LE(entry + 4), getUint64LE(entry + 8),
+                                 getUint64LE(entry + 16), getUint64LE(entry + 24)});
+        }
+    }
+    heights.close();
+
+    // Keep only height entries whose transactions all made it into txids.idx
+    error_code ec;
+    uint64_t txFileEntries = fs::exists(indexPath("txids.idx"), ec) ? fs::file_size(indexPath("txids.idx"), ec) : 0;
+    txFileEntries /= txEntrySize;
+    while (!locations.empty() && locations.back().firstTx + locations.back().txCount > txFileEntries) {
+        locations.pop_back();
+    }
+    const uint64_t txKeep = locations.empty() ? 0 : locations.back().firstTx + locations.back().txCount;
+
+    // Trim both files to the consistent prefix (creating them if they are missing)
+    for (const char* name : {"heights.idx", "txids.idx"}) {
+        ofstream touch(indexPath(name), ios::binary | ios::app);
+    }
+    fs::resize_file(indexPath("heights.idx"), locations.size() * heightEntrySize, ec);
+    if (ec) return false;
+    fs::resize_file(indexPath("txids.idx"), txKeep * txEntrySize, ec);
+    if (ec) return false;
+
+    // Index the blocks the files are missing, one segment at a time
+    const uint64_t from = locations.size();
+    if (from == count) return true;
+    uint32_t segment = 0;
+    while (segment + 1 < segmentFirstHeights.size() && segmentFirstHeights[segment + 1] <= from) ++segment;
+    uint64_t firstTx = txKeep;
+    for (; segment < segmentFirstHeights.size(); ++segment) {
+        MappedFile file;
+        if (!file.open(segmentPath(segment))) return false;
+        vector<Block> blocks;
+        vector<BlockLocation> newLocations;
+        uint64_t height = segmentFirstHeights[segment];
+        size_t offset = segmentHeaderSize;
+        while (offset < file.size() && height < count) {
+            size_t recordSize = 0;
+            vector<Block> decoded;
+            if (!decodeBlock(file.data() + offset, file.size() - offset, recordSize, decoded)) break;
+            if (height >= from) {
+                const uint32_t txCount = static_cast<uint32_t>(decoded.back().transactions.size());
+                newLocations.push_back({segment, txCount, offset, recordSize, firstTx});
+                firstTx += txCount;
+                blocks.push_back(move(decoded.back()));
+            }
+            offset += recordSize;
+            ++height;
+        }
+        vector<const vector<Transaction>*> bodies;
+        for (const Block& block : blocks) bodies.push_back(&block.transactions);
+        const uint64_t firstHeight = blocks.empty() ? 0 : static_cast<uint64_t>(blocks.front().index);
+        if (!writeIndexEntries(newLocations, bodies, firstHeight, nullptr)) return false;
+    }
+    return locations.size() == count;
+}
+
+bool BlockStore::writeIndexEntries(const vector<BlockLocation>& newLocations,
+                                   const vector<const vector<Transaction>*>& newBodies, size_t firstHeight,
+                                   const LeafIds& leafIds) {
+    if (newLocations.empty()) return true;
+    vector<uint8_t> heightBytes(newLocations.size() * heightEntrySize);
+    vector<uint8_t> txBytes;
+    for (size_t i = 0; i < newLocations.size(); ++i) {
+        const BlockLocation& location = newLocations[i];
+        uint8_t* entry = &heightBytes[i * heightEntrySize];
+        putUint32LE(entry, location.segment);
+        putUint32LE(entry + 4, location.txCount);
+        putUint64LE(entry + 8, location.offset);
+        putUint64LE(entry + 16, location.recordSize);
+        putUint64LE(entry + 24, location.firstTx);
+
+        const vector<Transaction>& transactions = *newBodies[i];
+        const Hash256* ids = leafIds ? leafIds(firstHeight + i) : nullptr;
+        for (size_t j = 0; j < transactions.size(); ++j) {
+            uint8_t txEntry[txEntrySize];
+            const Hash256 txHash = ids ? ids[j] : MerkleTree::leafHash(transactions[j]);
+            memcpy(txEntry, txHash.data(), 32);
+            putUint64LE(txEntry + 32, static_cast<uint64_t>(firstHeight + i));
+            putUint32LE(txEntry + 40, static_cast<uint32_t>(j));
+            txBytes.insert(txBytes.end(), txEntry, txEntry + txEntrySize);
+        }
+    }
+
+    // Transactions go first, so a crash in between leaves height entries that openIndexes trims
+    ofstream txFile(indexPath("txids.idx"), ios::binary | ios::app);
+    txFile.write(reinterpret_cast<const char*>(txBytes.data()), txBytes.size());
+    txFile.close();
+    ofstream heightFile(indexPath("heights.idx"), ios::binary | ios::app);
+    heightFile.write(reinterpret_cast<const char*>(heightBytes.data()), heightBytes.size());
+    heightFile.close();
+    if (!txFile || !heightFile) return false;
+
+    locations.insert(locations.end(), newLocations.begin(), newLocations.end());
+    return true;
+}
+
+uint64_t BlockStore::blockCount() const {
+    return count;
+}
+
+size_t BlockStore::scanSegment(const uint8_t* data, size_t size, uint64_t& records, Hash256& lastHash,
+                               vector<Block>* blocks) {
+    size_t offset = segmentHeaderSize;
+    while (offset < size) {
+        size_t recordSize = 0;
+        if (blocks) {
+            if (!decodeBlock(data + offset, size - offset, recordSize, *blocks)) break;
+        } else if (!checkRecord(data + offset, size - offset, recordSize)) {
+            break;
+        }
+        memcpy(lastHash.data(), data + offset + 16 + Block::headerSize, 32);
+        offset += recordSize;
+        ++records;
+    }
+    return offset;
+}
+
+bool BlockStore::append(const vector<Block>& chain, const LeafIds& leafIds, const Bodies& bodies) {
+    METRIC_TIME(storeAppendNanos);
+    if (chain.size() < count) return false; // The chain is shorter than what is already stored
+    if (count > 0 && chain[count - 1].hash() != tipHash) return false; // Stored history differs
+    if (chain.size() == count) return true;
+
+    // Encode every new block into one buffer and write it with a single call per segment
+    uint32_t segment = segmentFirstHeights.empty() ? 0 : static_cast<uint32_t>(segmentFirstHeights.size() - 1);
+    uint64_t segmentSize = lastSegmentEnd;
+    vector<uint8_t> pending;
+    vector<BlockLocation> newLocations;
+    vector<const vector<Transaction>*> newBodies;
+    for (size_t i = count; i < chain.size(); ++i) {
+        const vector<Transaction>* body = chain[i].bodyLoaded ? &chain[i].transactions
+                                        : bodies                ? bodies(i)
+                                                                : nullptr;
+        if (!body) return false; // A header-only block the store does not hold cannot be written
+        newBodies.push_back(body);
+    }
+    uint64_t firstTx = locations.empty() ? 0 : locations.back().firstTx + locations.back().txCount;
+    bool startSegment = segmentFirstHeights.empty();
+    if (!startSegment && lastSegmentEnd >= maxSegmentBytes) {
+        // Filled by earlier appends: cut any torn record off its end and start the next one
+        error_code ec;
+        fs::resize_file(segmentPath(segment), lastSegmentEnd, ec);
+        if (ec) return false;
+        ++segment;
+        startSegment = true;
+    }
+
+    auto flush = [&]() -> bool {
+        if (pending.empty()) return true;
+        const string path = segmentPath(segment);
+        firstUnsyncedSegment = min(firstUnsyncedSegment, segment);
+        if (startSegment) {
+            ofstream file(path, ios::binary | ios::trunc);
+            file.write(reinterpret_cast<const char*>(pending.data()), pending.size());
+            if (!file) return false;
+        } else {
+            // Drop any torn record left behind by an interrupted append, then add the new records
+            error_code ec;
+            fs::resize_file(path, lastSegmentEnd, ec);
+            if (ec) return false;
+            ofstream file(path, ios::binary | ios::app);
+            file.write(reinterpret_cast<const char*>(pending.data()), pending.size());
+            if (!file) return false;
+        }
+        pending.clear();
+        return true;
+    };
+
+    for (size_t i = count; i < chain.size(); ++i) {
+        if (startSegment && pending.empty()) {
+            uint8_t header[segmentHeaderSize];
+            memcpy(header, segmentMagic, 4);
+            putUint32LE(header + 4, formatVersion);
+            putUint64LE(header + 8, i);
+            pending.insert(pending.end(), header, header + segmentHeaderSize);
+            segmentFirstHeights.push_back(i);
+            segmentSize = segmentHeaderSize;
+        }
+        const vector<Transaction>* body = newBodies[i - count];
+        const size_t before = pending.size();
+        encodeBlock(chain[i], body->data(), body->size(), pending);
+        const uint32_t txCount = static_cast<uint32_t>(body->size());
+        newLocations.push_back({segment, txCount, segmentSize, pending.size() - before, firstTx});
+        firstTx += txCount;
+        segmentSize += pending.size() - before;
+
+        if (segmentSize >= maxSegmentBytes && i + 1 < chain.size()) {
+            if (!flush()) return false;
+            ++segment;
+            startSegment = true;
+        }
+    }
+    if (!flush()) return false;
+
+    const size_t firstHeight = count;
+    METRIC_ADD(storeBlocksWritten, newLocations.size());
+#if METRICS_ENABLED
+    for (const BlockLocation& location : newLocations) METRIC_ADD(storeBytesWritten, location.recordSize);
+#endif
+    count = chain.size();
+    lastSegmentEnd = segmentSize;
+    tipHash = chain.back().hash();
+    return writeIndexEntries(newLocations, newBodies, firstHeight, leafIds);
+}
+
+shared_ptr<MappedFile> BlockStore::mapSegment(uint32_t segment, uint64_t end) const {
+    lock_guard<std::mutex> lock(mutex);
+    if (maps.size() <= segment) maps.resize(segment + 1);
+    if (!maps[segment] || maps[segment]->size() < end) {
+        // Not mapped yet, or mapped before the segment grew past end
+        auto file = make_shared<MappedFile>();
+        if (!file->open(segmentPath(segment)) || file->size() < end) return nullptr;
+        maps[segment] = file;
+    }
+    return maps[segment];
+}
+
+bool BlockStore::loadHeaders(vector<Block>& blocks) const {
+    METRIC_TIME(storeLoadNanos);
+    blocks.clear();
+    blocks.reserve(locations.size());
+    for (const BlockLocation& location : locations) {
+        shared_ptr<MappedFile> file = mapSegment(location.segment, location.offset + location.recordSize);
+        if (!file) return false;
+        const uint8_t* record = file->data() + location.offset;
+        Hash256 storedHash;
+        memcpy(storedHash.data(), record + 16 + Block::headerSize, 32);
+        blocks.emplace_back(record + 16, storedHash, vector<Transaction>{});
+        blocks.back().bodyLoaded = false;
+        size_t bloomSize = 0;
+        if (!getBloom(record, getUint32LE(record + 4), blocks.back().bloom, bloomSize)) return false;
+        METRIC_ADD(storeBlocksRead, 1);
+        METRIC_ADD(storeBytesRead, recordHeaderSize + bloomSize);
+    }
+    return blocks.size() == count;
+}
+
+bool BlockStore::readBody(uint64_t height, vector<Transaction>& transactions) const {
+    if (height >= locations.size()) return false;
+    const BlockLocation& location = locations[height];
+    shared_ptr<MappedFile> file = mapSegment(location.segment, location.offset + location.recordSize);
+    if (!file) return false;
+    vector<Block> decoded;
+    size_t recordSize = 0;
+    if (!decodeBlock(file->data() + location.offset, location.recordSize, recordSize, decoded)) return false;
+    METRIC_ADD(storeBlocksRead, 1);
+    METRIC_ADD(storeBytesRead, recordSize);
+    transactions = move(decoded.back().transactions);
+    return true;
+}
+
+bool BlockStore::forEachTransaction(const function<void(const Hash256&, uint64_t, uint32_t)>& fn) const {
+    const uint64_t entries = locations.empty() ? 0 : locations.back().firstTx + locations.back().txCount;
+    if (entries == 0) return true;
+    MappedFile file;
+    if (!file.open(indexPath("txids.idx")) || file.size() < entries * txEntrySize) return false;
+    Hash256 txHash;
+    for (uint64_t i = 0; i < entries; ++i) {
+        const uint8_t* entry = file.data() + i * txEntrySize;
+        memcpy(txHash.data(), entry, 32);
+        fn(txHash, getUint64LE(entry + 32), getUint32LE(entry + 40));
+    }
+    return true;
+}
+
+// Segments first, then the indexes (rebuilt from the segments if they are lost), then the directory
+// so newly created files are found again after a crash
+bool BlockStore::sync() {
+    if (firstUnsyncedSegment == UINT32_MAX) return true;
+    for (uint32_t segment = firstUnsyncedSegment; segment < segmentFirstHeights.size(); ++segment) {
+        if (!syncPath(segmentPath(segment))) return false;
+    }
+    if (!syncPath(indexPath("txids.idx")) || !syncPath(indexPath("heights.idx")) || !syncPath(directory)) {
+        return false;
+    }
+    firstUnsyncedSegment = UINT32_MAX;
+    return true;
+}
+
+bool BlockStore::load(vector<Block>& blocks) const {
+    METRIC_TIME(storeLoadNanos);
+    blocks.clear();
+    blocks.reserve(count);
+    for (uint32_t segment = 0; segment < segmentFirstHeights.size(); ++segment) {
+        MappedFile file;
+        if (!file.open(segmentPath(segment))) return false;
+        uint64_t records = 0;
+        Hash256 lastHash;
+        [[maybe_unused]] const size_t end = scanSegment(file.data(), file.size(), records, lastHash, &blocks);
+        METRIC_ADD(storeBlocksRead, records);
+        METRIC_ADD(storeBytesRead, end - segmentHeaderSize);
+    }
+    return blocks.size() == count;
+}
+
+void BlockStore::encodeBlock(const Block& block, vector<uint8_t>& out) {
+    encodeBlock(block, block.transactions.data(), block.transactions.size(), out);
+}
+
+void BlockStore::encodeBlock(const Block& block, const Transaction* transactions, size_t count,
+                             vector<uint8_t>& out) {
+    const size_t start = out.size();
+    const vector<uint64_t>& words = block.bloom.words();
+    out.resize(start + recordHeaderSize + 8 + words.size() * 8);
+
+    // Bloom filter section: word count (4) | hash count (1) | reserved (3) | words (8 each)
+    uint8_t* section = &out[start + recordHeaderSize];
+    putUint32LE(section, static_cast<uint32_t>(words.size()));
+    section[4] = block.bloom.getHashCount();
+    for (size_t i = 0; i < words.size(); ++i) {
+        putUint64LE(section + 8 + 8 * i, words[i]);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        const Transaction& tx = transactions[i];
+        const size_t txStart = out.size();
+        const size_t txSize = tx.encodedSize();
+        out.resize(txStart + 4 + txSize);
+        putUint32LE(&out[txStart], static_cast<uint32_t>(txSize));
+        tx.encode(&out[txStart + 4]); // Same bytes the transaction id hashes
+    }
+
+    uint8_t* record = &out[start];
+    memcpy(record, recordMagic, 4);
+    putUint32LE(record + 4, static_cast<uint32_t>(out.size() - start - recordHeaderSize));
+    putUint32LE(record + 8, static_cast<uint32_t>(count));
+    block.encodeHeader(record + 16);
+    memcpy(record + 16 + Block::headerSize, block.hash().data(), 32);
+    putUint32LE(record + 12, crc32(record + 16, out.size() - start - 16));
+}
+
+bool BlockStore::checkRecord(const uint8_t* data, size_t available, size_t& recordSize) {
+    if (available < recordHeaderSize) return false;
+    if (memcmp(data, recordMagic, 4) != 0) return false;
+    const uint32_t bodyLength = getUint32LE(data + 4);
+    if (available - recordHeaderSize < bodyLength) return false;
+    recordSize = recordHeaderSize + bodyLength;
+    return crc32(data + 16, recordSize - 16) == getUint32LE(data + 12);
+}
+
+bool BlockStore::decodeBlock(const uint8_t* data, size_t available, size_t& recordSize, vector<Block>& blocks) {
+    if (!checkRecord(data, available, recordSize)) return false;
+    const uint32_t bodyLength = getUint32LE(data + 4);
+    const uint32_t txCount = getUint32LE(data + 8);
+
+    BloomFilter bloom;
+    size_t bloomSize = 0;
+    if (!getBloom(data, bodyLength, bloom, bloomSize)) return false;
+
+    vector<Transaction> transactions = BodyPool::global().acquire(txCount);
+    const uint8_t* pos = data + recordHeaderSize + bloomSize;
+    const uint8_t* end = data + recordHeaderSize + bodyLength;
+    for (uint32_t i = 0; i < txCount; ++i) {
+        if (end - pos < 4) return false;
+        const uint32_t txSize = getUint32LE(pos);
+        pos += 4;
+        if (static_cast<size_t>(end - pos) < txSize) return false;
+        optional<Transaction> tx = Transaction::decode(pos, txSize);
+        if (!tx) return false;
+        transactions.push_back(*tx);
+        pos += txSize;
+    }
+
+    Hash256 storedHash;
+    memcpy(storedHash.data(), data + 16 + Block::headerSize, 32);
+    blocks.emplace_back(data + 16, storedHash, move(transactions));
+    blocks.back().bloom = move(bloom);
+    return true;
+}
@@ -1,130 +1,625 @@
 #include "Blockchain.h"
+#include "AccountRegistry.h"
+#include "BlockStore.h"
+#include "BodyPool.h"
+#include "ByteOrder.h"
+#include "LogWriter.h"
+#include "Metrics.h"
+#include "ThreadPool.h"
+#include "WriteAheadLog.h"
+#include "sha256.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <ctime>
-#include <fstream>
-#include <iostream>
-#include <sstream>
+#include <filesystem>
 
 using namespace std;
+namespace fs = std::filesystem;
 
 // Constructor for Block
-Block::Block(int idx, const string& prevHash, const vector<Transaction>& txs)
-    : index(idx), previousHash(prevHash), transactions(txs), nonce(0) {
-    // Compute the Merkle root for the transactions in this block
-    merkleRoot = MerkleTree(transactions).getRootHash();
+Block::Block(int idx, const Hash256& prevHash, const vector<Transaction>& txs)
+    : Block(idx, prevHash, txs, MerkleTree(txs)) {}
+
+Block::Block(int idx, const Hash256& prevHash, const vector<Transaction>& txs, const MerkleTree& tree)
+    : Block(idx, prevHash, vector<Transaction>(txs), tree) {}
+
+Block::Block(int idx, const Hash256& prevHash, vector<Transaction>&& txs, const MerkleTree& tree)
+    : Block(idx, prevHash, move(txs), tree.getRootHash()) {}
+
+Block::Block(int idx, const Hash256& prevHash, vector<Transaction>&& txs, const MerkleAccumulator& leaves)
+    : Block(idx, prevHash, move(txs), leaves.getRootHash()) {}
+
+Block::Block(int idx, const Hash256& prevHash, vector<Transaction>&& txs, const Hash256& root)
+    : index(idx), previousHash(prevHash), merkleRoot(root), difficulty(0), nonce(0), transactions(move(txs)) {
+    bloom = buildBloom(transactions);
     // Set the timestamp to the current time
-    timestamp = to_string(time(nullptr));
+    timestamp = time(nullptr);
+    seal();
+}
+
+// Names, not ids: ids are not stable across runs
+BloomFilter Block::buildBloom(const vector<Transaction>& txs) {
+    BloomFilter filter(2 * txs.size());
+    for (const Transaction& tx : txs) {
+        filter.add(tx.sender());
+        filter.add(tx.receiver());
+    }
+    return filter;
+}
+
+// Constructor for a block loaded from the block store
+Block::Block(const uint8_t header[headerSize], const Hash256& storedHash, vector<Transaction>&& txs)
+    : index(static_cast<int>(getUint32LE(header))),
+      timestamp(static_cast<int64_t>(getUint64LE(header + 100))),
+      difficulty(getUint16LE(header + 108)),
+      nonce(getUint64LE(header + nonceOffset)),
+      transactions(move(txs)),
+      blockHash(storedHash) {
+    memcpy(previousHash.data(), header + 4, previousHash.size());
+    memcpy(merkleRoot.data(), header + 36, merkleRoot.size());
+    memcpy(stateRoot.data(), header + 68, stateRoot.size());
+}
+
+// Return the hash cached when the block was sealed
+const Hash256& Block::hash() const {
+    return blockHash;
+}
+
+// Compute the hash of the block over its canonical header encoding
+Hash256 Block::computeHash() const {
+    uint8_t header[headerSize];
+    encodeHeader(header);
+    Hash256 digest;
+    calc_sha_256(digest.data(), header, headerSize);
+    METRIC_ADD(sha256Calls, 1);
+    METRIC_ADD(sha256Bytes, headerSize);
+    return digest;
+}
+
+// Header layout: index (4) | previousHash (32) | merkleRoot (32) | stateRoot (32) | timestamp (8)
+// | difficulty (2) | nonce (8). Narrow index and difficulty fields keep the bytes after the first
+// SHA-256 chunk small enough for the miner's midstate trick.
+void Block::encodeHeader(uint8_t out[headerSize]) const {
+    putUint32LE(out, static_cast<uint32_t>(index));
+    memcpy(out + 4, previousHash.data(), previousHash.size());
+    memcpy(out + 36, merkleRoot.data(), merkleRoot.size());
+    memcpy(out + 68, stateRoot.data(), stateRoot.size());
+    putUint64LE(out + 100, static_cast<uint64_t>(timestamp));
+    putUint16LE(out + 108, static_cast<uint16_t>(min<uint32_t>(difficulty, UINT16_MAX)));
+    putUint64LE(out + nonceOffset, nonce);
 }
 
-// Compute the hash of the block
-string Block::hash() const {
-    string blockData = to_string(index) + previousHash + merkleRoot + timestamp + to_string(nonce);
-    return MerkleTree({Transaction("hash", blockData, 0)}).getRootHash(); // Reuse hashing for simplicity
+void Block::seal() {
+    blockHash = computeHash();
 }
 
 // Constructor for Blockchain
 Blockchain::Blockchain() {
     // Create the genesis block (first block in the chain)
-    chain.emplace_back(0, "0", vector<Transaction>{});
+    chain.emplace_back(0, Hash256(), vector<Transaction>{});
+    indexBlock(0, nullptr);
+}
+
+Blockchain::~Blockchain() {
+    logWriter.reset(); // Finishes the writes already queued
+    if (log) log->sync(); // Blocks added since the last syncLog are still only buffered
 }
 
 // Add a block to the blockchain
-void Blockchain::addBlock(const vector<Transaction>& transactions) {
-    int index = chain.size(); // Get the current index
-    string previousHash = chain.back().hash(); // Get the hash of the last block
-    Block newBlock(index, previousHash, transactions); // Create a new block
-    chain.push_back(newBlock); // Add it to the chain
+bool Blockchain::addBlock(const vector<Transaction>& transactions) {
+    vector<Transaction> copy = BodyPool::global().acquire(transactions.size());
+    copy.assign(transactions.begin(), transactions.end());
+    return addBlock(move(copy));
 }
 
-// Validate the blockchain to ensure integrity
-bool Blockchain::validateChain() const {
-    for (size_t i = 1; i < chain.size(); ++i) {
-        const Block& current = chain[i]; // Current block
-        const Block& previous = chain[i - 1]; // Previous block
-
-        // Check if the hash and merkle root are correct
-        if (current.previousHash != previous.hash() || 
-            current.merkleRoot != MerkleTree(current.transactions).getRootHash()) {
-            return false; // Chain is invalid
+// The block is built in place at the end of the chain, taking over the transactions' storage
+bool Blockchain::addBlock(vector<Transaction>&& transactions) {
+    METRIC_TIME(addBlockNanos);
+    if (!catchUpState() || !state.apply(transactions, balanceCheck)) return refuseBlock();
+    const int index = chain.size(); // Get the current index
+    const Hash256 previousHash = chain.back().hash(); // Copied: emplace_back may reallocate chain
+    MerkleTree tree(transactions); // Its leaves double as the transaction ids for txIndex
+    chain.emplace_back(index, previousHash, move(transactions), tree);
+    return sealLastBlock(transactions, tree.leafData());
+}
+
+bool Blockchain::addBlock(vector<Transaction>&& transactions, const MerkleAccumulator& leaves,
+                          const Hash256* leafIds) {
+    METRIC_TIME(addBlockNanos);
+    if (leaves.leafCount() != transactions.size()) return refuseBlock();
+    if (!catchUpState() || !state.apply(transactions, balanceCheck)) return refuseBlock();
+    const int index = chain.size();
+    const Hash256 previousHash = chain.back().hash();
+    chain.emplace_back(index, previousHash, move(transactions), leaves);
+    return sealLastBlock(transactions, leafIds);
+}
+
+// A refused block still uses up its search number, so a cancel aimed at it cannot stop the next one
+bool Blockchain::refuseBlock() {
+    if (difficulty > 0) miner->skip();
+    return false;
+}
+
+// The state already holds the block's transfers. On a cancelled search they are undone, the block
+// is removed again and its transactions handed back.
+bool Blockchain::sealLastBlock(vector<Transaction>& transactions, const Hash256* leafIds) {
+    Block& block = chain.back();
+    block.stateRoot = state.rootHash();
+    block.difficulty = difficulty;
+    block.seal();
+    if (difficulty > 0) {
+        lastMiningResult = miner->mine(block); // Search for a nonce meeting the target
+        if (!lastMiningResult.found) {
+            transactions = move(block.transactions);
+            chain.pop_back();
+            state.undo();
+            return false;
         }
     }
-    return true; // Chain is valid
+    stateHeight = chain.size();
+    indexBlock(chain.size() - 1, leafIds); // Reads the body, so before it moves out below
+    if (logWriter) {
+        // The body moves into a handle shared by the writer's job and unstoredBlocks (which indexBlock
+        // just extended), and the chain keeps the header. The last of them to let go returns the
+        // buffer to the pool.
+        shared_ptr<vector<Transaction>> body(new vector<Transaction>(move(block.transactions)),
+                                             [](vector<Transaction>* released) {
+                                                 BodyPool::global().release(move(*released));
+                                                 delete released;
+                                             });
+        block.transactions.clear();
+        block.bodyLoaded = false;
+        unstoredBlocks.back().body = body;
+        uint8_t header[Block::headerSize];
+        block.encodeHeader(header);
+        Block copy(header, block.hash(), vector<Transaction>());
+        copy.bloom = block.bloom;
+        logWriter->submit(move(copy), move(body), nullptr);
+    } else if (log) {
+        log->append(block); // Durable once syncLog writes it out
+    }
+    return true;
+}
+
+void Blockchain::indexBlock(size_t height, const Hash256* leafIds) {
+    const vector<Transaction>& transactions = chain[height].transactions;
+    for (size_t i = 0; i < transactions.size(); ++i) {
+        txIndex.emplace(leafIds[i], TransactionLocation{height, i}); // A repeated id keeps its first location
+    }
+    if (height == unstoredHeight + unstoredBlocks.size()) {
+        unstoredBlocks.push_back({vector<Hash256>(leafIds, leafIds + transactions.size()), nullptr});
+    }
+    indexTimestamp(height);
+    indexAccounts(height, transactions);
 }
-void Block::setHash(const std::string& hash) {
-    blockHash = hash;
+
+const Hash256* Blockchain::unstoredIds(uint64_t height) const {
+    if (height < unstoredHeight || height - unstoredHeight >= unstoredBlocks.size()) return nullptr;
+    return unstoredBlocks[height - unstoredHeight].ids.data();
 }
 
-void Block::setTimestamp(const std::string& timestamp) {
-    this->timestamp = timestamp;
+const vector<Transaction>* Blockchain::unstoredBody(uint64_t height) const {
+    if (height < unstoredHeight || height - unstoredHeight >= unstoredBlocks.size()) return nullptr;
+    return unstoredBlocks[height - unstoredHeight].body.get();
 }
 
+// Timestamps normally grow with height, so this is an append; an older one is inserted in place
+void Blockchain::indexTimestamp(size_t height) {
+    const pair<int64_t, uint32_t> entry(chain[height].timestamp, static_cast<uint32_t>(height));
+    blockTimes.insert(upper_bound(blockTimes.begin(), blockTimes.end(), entry), entry);
+}
 
-// Save the blockchain to a file
-void Blockchain::saveToFile(const string& filename) const {
-    ofstream file(filename);
-    if (file.is_open()) {
-        for (const Block& block : chain) {
-            file << "Block " << block.index << "\n";
-            file << block.previousHash << " " << block.hash() << " " << block.timestamp << "\n";
-            file << block.transactions.size() << "\n"; // Number of transactions in the block
-            for (const Transaction& txn : block.transactions) {
-                file << txn.sender << " " << txn.receiver << " " << txn.amount << "\n";
-            }
-            file << "EndBlock\n";
+// A transfer to oneself is listed as both sent and received
+void Blockchain::indexAccounts(size_t height, const vector<Transaction>& transactions) {
+    for (size_t i = 0; i < transactions.size(); ++i) {
+        const Transaction& tx = transactions[i];
+        const size_t highestId = max(tx.senderId, tx.receiverId);
+        if (highestId >= accountHistory.size()) accountHistory.resize(highestId + 1);
+        const Posting posting{static_cast<uint32_t>(height), static_cast<uint32_t>(i)};
+        accountHistory[tx.senderId].sent.push_back(posting);
+        accountHistory[tx.receiverId].received.push_back(posting);
+    }
+}
+
+void Blockchain::resetHistoryIndexes(bool bodiesResident) {
+    blockTimes.clear();
+    blockTimes.reserve(chain.size());
+    for (size_t height = 0; height < chain.size(); ++height) {
+        blockTimes.emplace_back(chain[height].timestamp, static_cast<uint32_t>(height));
+    }
+    sort(blockTimes.begin(), blockTimes.end()); // Usually in order already
+    accountHistory.clear();
+    accountIndexFrom = bodiesResident ? 0 : chain.size();
+    for (size_t height = 0; height < chain.size() && bodiesResident; ++height) {
+        indexAccounts(height, chain[height].transactions);
+    }
+}
+
+// Only bodies whose filter may hold the name are read; a false positive costs one wasted read
+// Reading a body interns its names, so a name the registry does not know yet turns up with the
+// first body that holds it; until then the bodies read were false positives.
+bool Blockchain::scanStoredBlocks(const string& account) {
+    AccountHistory found;
+    uint32_t accountId = 0;
+    bool known = AccountRegistry::global().find(account, accountId);
+    for (size_t height = 0; height < accountIndexFrom; ++height) {
+        if (!chain[height].bloom.mayContain(account)) continue;
+        BlockCache::Body body = getTransactions(height);
+        if (!body) return false;
+        if (!known && !(known = AccountRegistry::global().find(account, accountId))) continue;
+        for (size_t i = 0; i < body->size(); ++i) {
+            const Posting posting{static_cast<uint32_t>(height), static_cast<uint32_t>(i)};
+            if ((*body)[i].senderId == accountId) found.sent.push_back(posting);
+            if ((*body)[i].receiverId == accountId) found.received.push_back(posting);
         }
-        file.close();
-        cout << "Blockchain saved to " << filename << "\n";
-    } else {
-        cerr << "Failed to open file for saving blockchain.\n";
     }
+    if (!known) return true; // In no block at all
+    if (accountId >= accountHistory.size()) accountHistory.resize(accountId + 1);
+    // Stored blocks precede every indexed one, so their postings go in front
+    AccountHistory& history = accountHistory[accountId];
+    history.sent.insert(history.sent.begin(), found.sent.begin(), found.sent.end());
+    history.received.insert(history.received.begin(), found.received.begin(), found.received.end());
+    history.scanned = true;
+    return true;
+}
+
+bool Blockchain::loadTransactionIndex(const BlockStore& source) {
+    unordered_map<Hash256, TransactionLocation> loaded;
+    const bool ok = source.forEachTransaction([&loaded](const Hash256& txId, uint64_t height, uint32_t position) {
+        loaded.emplace(txId, TransactionLocation{static_cast<size_t>(height), position}); // In chain order
+    });
+    if (ok) txIndex = move(loaded);
+    return ok;
+}
+
+bool Blockchain::findTransaction(const Hash256& txId, TransactionLocation& location) const {
+    auto found = txIndex.find(txId);
+    if (found == txIndex.end()) return false;
+    location = found->second;
+    return true;
+}
+
+void Blockchain::setDifficulty(uint32_t bits) {
+    difficulty = max(minimumDifficulty, min<uint32_t>(bits, 256)); // No hash has more leading zero bits
+}
+
+void Blockchain::setMinimumDifficulty(uint32_t bits) {
+    minimumDifficulty = min<uint32_t>(bits, 256);
+    difficulty = max(difficulty, minimumDifficulty);
+}
+
+uint32_t Blockchain::getMinimumDifficulty() const {
+    return minimumDifficulty;
+}
+
+uint32_t Blockchain::getDifficulty() const {
+    return difficulty;
+}
+
+void Blockchain::cancelMining() {
+    miner->cancel();
+}
+
+void Blockchain::cancelMining(uint64_t search) {
+    miner->cancel(search);
+}
+
+uint64_t Blockchain::nextMiningSearch() const {
+    return miner->nextSearch();
+}
+
+const MiningResult& Blockchain::getLastMiningResult() const {
+    return lastMiningResult;
+}
+
+// Validate the blockchain to ensure integrity
+bool Blockchain::validateChain() {
+    size_t failedIndex;
+    return validateChain(failedIndex);
+}
+
+// Blocks already applied to state had their state roots checked then, and validateRange has just
+// confirmed that their headers and transactions are unchanged, so only the rest are replayed
+bool Blockchain::validateChain(size_t& failedIndex) {
+    return validateRange(1, chain.size(), failedIndex) && catchUpState(&failedIndex);
+}
+
+// Only the blocks past validatedHeight are checked, so blocks edited in place after they were
+// validated are not noticed here; use validateChain for a full pass.
+bool Blockchain::validateNewBlocks(size_t& failedIndex) {
+    if (validatedHeight >= chain.size()) validatedHeight = 0; // Chain was replaced or shortened
+    if (!validateRange(validatedHeight + 1, chain.size(), failedIndex) || !catchUpState(&failedIndex)) {
+        return false;
+    }
+    validatedHeight = chain.empty() ? 0 : chain.size() - 1;
+    return true;
+}
+
+void Blockchain::setBalanceCheck(bool enabled) {
+    balanceCheck = enabled;
+}
+
+const StateTree* Blockchain::getState() {
+    return catchUpState() ? &state : nullptr;
 }
 
-// Load the blockchain from a file
-void Blockchain::loadFromFile(const string& filename) {
-    ifstream infile(filename);
-    if (!infile.is_open()) {
-        cout << "Could not open blockchain data file. Starting with an empty blockchain.\n";
-        return;
+bool Blockchain::getBalance(const string& account, int64_t& balance, StateProof* proof) {
+    if (!catchUpState()) return false;
+    const Hash256 key = StateTree::accountKey(account);
+    balance = 0;
+    state.balance(key, balance);
+    if (proof) *proof = state.prove(key);
+    return true;
+}
+
+// Blocks opened from a store, replayed from the log or loaded are applied here the first time
+// the state is needed
+bool Blockchain::catchUpState(size_t* failedIndex) {
+    for (; stateHeight < chain.size(); ++stateHeight) {
+        BlockCache::Body body = getTransactions(stateHeight);
+        if (!body || !state.apply(*body, false) || state.rootHash() != chain[stateHeight].stateRoot) {
+            if (failedIndex) *failedIndex = stateHeight;
+            state.clear();
+            stateHeight = 0;
+            return false;
+        }
     }
+    return true;
+}
 
-    string line;
-    while (getline(infile, line)) {
-        if (line.find("Block") != string::npos) {
-            int idx;
-            string prevHash, hash, timestamp, txLine;
+bool Blockchain::validateBlock(size_t i) const {
+    METRIC_TIME(validateBlockNanos);
+    const Block& current = chain[i]; // Current block
+    const Block& previous = chain[i - 1]; // Previous block
 
-            // Read block data
-            infile >> idx >> prevHash >> hash >> timestamp;
-            vector<Transaction> transactions;
+    // Check that the cached hash matches the header and meets its proof-of-work target, which may
+    // not be below the chain's minimum, then the link and the merkle root
+    if (current.hash() != current.computeHash() || current.difficulty < minimumDifficulty ||
+        !Miner::meetsDifficulty(current.hash(), current.difficulty) ||
+        current.previousHash != previous.hash()) {
+        return false;
+    }
+    BlockCache::Body transactions = getTransactions(i);
+    return transactions && current.merkleRoot == MerkleTree(*transactions).getRootHash();
+}
 
-            // Read transactions for the block
-            while (getline(infile, txLine) && txLine.find("EndBlock") == string::npos) {
-                istringstream txStream(txLine);
-                string sender, receiver;
-                double amount;
+// Every block is checked independently on the shared pool. Once a block fails, chunks skip
+// blocks above the lowest failure seen so far, so the reported index is the first bad block.
+bool Blockchain::validateRange(size_t begin, size_t end, size_t& failedIndex) const {
+    if (begin >= end) return true;
 
-                txStream >> sender >> receiver >> amount;
-                transactions.emplace_back(sender, receiver, amount);
+    const size_t none = SIZE_MAX;
+    atomic<size_t> firstFailure{none};
+    ThreadPool::shared().parallelFor(end - begin, 8, [&](size_t chunkBegin, size_t chunkEnd) {
+        for (size_t i = begin + chunkBegin; i < begin + chunkEnd; ++i) {
+            if (i > firstFailure.load(memory_order_relaxed)) return; // Stop early, a lower block already failed
+            if (!validateBlock(i)) {
+                size_t seen = firstFailure.load();
+                while (i < seen && !firstFailure.compare_exchange_weak(seen, i)) {
+                }
+                return;
             }
+        }
+    });
 
-            // Recreate the block and set additional properties
-            Block newBlock(idx, prevHash, transactions);
-            newBlock.setHash(hash);
-            newBlock.setTimestamp(timestamp);
-            chain.push_back(newBlock);
-
-            // Debug output for each loaded block
-            cout << "Loaded Block #" << idx << "\n";
-            cout << "Hash: " << hash << "\n";
-            cout << "Previous Hash: " << prevHash << "\n";
-            cout << "Timestamp: " << timestamp << "\n";
-            cout << "Transactions:\n";
-            for (const auto& tx : transactions) {
-                cout << "  " << tx.sender << " -> " << tx.receiver << ", Amount: " << tx.amount << "\n";
-            }
-            cout << "End of Block\n\n";
+    if (firstFailure == none) return true; // Chain is valid
+    failedIndex = firstFailure;
+    return false; // Chain is invalid
+}
+
+// Either merges the sent and received lists, which are both in chain order
+bool Blockchain::forEachAccountTransaction(const string& account, AccountRole role,
+                                           const function<bool(const TransactionLocation&, const Transaction&)>& visit) {
+    // Looked up without interning, so querying unknown names does not grow the registry
+    uint32_t accountId;
+    bool known = AccountRegistry::global().find(account, accountId);
+    if (accountIndexFrom > 0 && (!known || accountId >= accountHistory.size() || !accountHistory[accountId].scanned)) {
+        // A name absent from the stored blocks is not remembered, so asking again repeats the filter checks
+        if (!scanStoredBlocks(account)) return false;
+        known = AccountRegistry::global().find(account, accountId);
+    }
+    if (!known || accountId >= accountHistory.size()) return true;
+    const AccountHistory& history = accountHistory[accountId];
+    const vector<Posting> none;
+    const vector<Posting>& sent = role == AccountRole::Receiver ? none : history.sent;
+    const vector<Posting>& received = role == AccountRole::Sender ? none : history.received;
+
+    auto before = [](const Posting& a, const Posting& b) {
+        return a.height < b.height || (a.height == b.height && a.position < b.position);
+    };
+    BlockCache::Body body;
+    size_t bodyHeight = SIZE_MAX;
+    size_t s = 0;
+    size_t r = 0;
+    while (s < sent.size() || r < received.size()) {
+        Posting next;
+        if (r == received.size() || (s < sent.size() && before(sent[s], received[r]))) {
+            next = sent[s++];
+        } else {
+            next = received[r++];
+            if (s < sent.size() && !before(next, sent[s])) ++s; // The same transfer, to oneself
         }
+        if (next.height != bodyHeight) {
+            body = getTransactions(next.height);
+            if (!body) return false;
+            bodyHeight = next.height;
+        }
+        if (!visit({next.height, next.position}, (*body)[next.position])) break;
+    }
+    return true;
+}
+
+void Blockchain::forEachBlockBetween(int64_t from, int64_t to, const function<bool(size_t)>& visit) const {
+    auto entry = lower_bound(blockTimes.begin(), blockTimes.end(), make_pair(from, uint32_t(0)));
+    for (; entry != blockTimes.end() && entry->first <= to; ++entry) {
+        if (!visit(entry->second)) return;
     }
+}
+
+// Find the block holding a transaction and return its Merkle inclusion proof
+bool Blockchain::getTransactionProof(const Hash256& txHash, size_t& blockIndex, MerkleProof& proof) const {
+    TransactionLocation location;
+    if (!findTransaction(txHash, location)) return false;
+    BlockCache::Body body = getTransactions(location.blockIndex);
+    if (!body) return false;
+    blockIndex = location.blockIndex;
+    proof = MerkleTree(*body).getProof(location.position);
+    return true;
+}
+
+void Block::setNonce(uint64_t nonce) {
+    this->nonce = nonce;
+    seal();
+}
+
 
-    infile.close();
-    cout << "Loaded blockchain from file.\n";
+// Save the blockchain to the block store. Only blocks the store does not hold yet are written.
+bool Blockchain::saveToFile(const string& path) const {
+    if (store && store->getDirectory() == path) {
+        // Header-only blocks are already in the open store
+        return store->append(chain, [this](uint64_t height) { return unstoredIds(height); },
+                             [this](uint64_t height) { return unstoredBody(height); });
+    }
+    BlockStore target(path);
+    return target.open() && target.append(chain, [this](uint64_t height) { return unstoredIds(height); },
+                                          [this](uint64_t height) { return unstoredBody(height); });
+}
+
+// Load the blockchain from the block store, replacing the current chain
+bool Blockchain::loadFromFile(const string& path) {
+    BlockStore store(path);
+    if (!store.open() || store.blockCount() == 0) return false;
+
+    vector<Block> loaded;
+    if (!store.load(loaded)) return false;
+    if (!loadTransactionIndex(store)) return false;
+    logWriter.reset(); // Finishes first: it writes to the log dropped below
+    chain = move(loaded);
+    validatedHeight = 0; // Loaded blocks have not been validated yet
+    state.clear(); // Rebuilt from the blocks when next needed
+    stateHeight = 0;
+    unstoredBlocks.clear(); // Every loaded block is stored already
+    unstoredHeight = chain.size();
+    resetHistoryIndexes(true);
+    if (log) log->sync(); // Its blocks are replayed the next time its store is opened
+    log.reset();
+    this->store.reset(); // Every body is resident now
+    cache.reset();
+    return true;
+}
+
+// Open the block store with only headers resident, then recover the blocks in its log
+bool Blockchain::openStore(const string& path, size_t cacheBudgetBytes) {
+    if (!syncLogAsync().get()) return false; // Reopening the same store must not lose buffered blocks
+    auto opened = make_unique<BlockStore>(path);
+    if (!opened->open() || opened->blockCount() == 0) return false;
+
+    vector<Block> headers;
+    if (!opened->loadHeaders(headers) || !loadTransactionIndex(*opened)) return false;
+    auto openedLog = make_unique<WriteAheadLog>((fs::path(path) / "wal.log").string());
+    vector<Block> logged;
+    if (!openedLog->open(logged)) return false;
+    chain = move(headers);
+    validatedHeight = 0;
+    state.clear();
+    stateHeight = 0;
+    unstoredBlocks.clear();
+    unstoredHeight = chain.size();
+    resetHistoryIndexes(false);
+    store = move(opened);
+    cache = make_unique<BlockCache>(cacheBudgetBytes);
+    logWriter.reset();
+    log = move(openedLog);
+    if (logWriterDepth > 0) logWriter = make_unique<LogWriter>(*log, logWriterDepth);
+
+    // Compacting right away leaves an empty log, so new blocks never follow a record replay rejected
+    replayLog(logged);
+    return logged.empty() || compactLog();
+}
+
+// Logged blocks the store already holds are skipped: a compaction stopped before emptying the log
+void Blockchain::replayLog(vector<Block>& logged) {
+    for (Block& block : logged) {
+        const size_t height = static_cast<size_t>(block.index);
+        if (height < chain.size()) {
+            if (block.hash() != chain[height].hash()) return; // From some other history
+            continue;
+        }
+        if (height != chain.size() || block.previousHash != chain.back().hash()) return;
+        if (block.computeHash() != block.hash() || block.difficulty < minimumDifficulty ||
+            !Miner::meetsDifficulty(block.hash(), block.difficulty)) {
+            return;
+        }
+        MerkleTree tree(block.transactions); // Its leaves double as the transaction ids for txIndex
+        if (tree.getRootHash() != block.merkleRoot) return;
+        chain.push_back(move(block));
+        indexBlock(height, tree.leafData());
+    }
+}
+
+// Resident bodies are shared without ownership; the chain outlives the caller's use of them
+BlockCache::Body Blockchain::getTransactions(size_t height) const {
+    const Block& block = chain[height];
+    if (block.bodyLoaded) {
+        return BlockCache::Body(shared_ptr<void>(), &block.transactions);
+    }
+    if (height >= unstoredHeight && height - unstoredHeight < unstoredBlocks.size() &&
+        unstoredBlocks[height - unstoredHeight].body) {
+        return unstoredBlocks[height - unstoredHeight].body; // Handed to the log writer, not stored yet
+    }
+    if (!store || !cache) return nullptr;
+    return cache->get(height, [&](vector<Transaction>& transactions) {
+        return store->readBody(height, transactions);
+    });
+}
+
+void Blockchain::setCacheBudget(size_t bytes) {
+    if (cache) cache->setBudget(bytes);
+}
+
+bool Blockchain::syncLog() {
+    if (!log) return true; // Without an open store, blocks live in memory until saved
+    if (!syncLogAsync().get()) return false;
+    return log->size() < logCompactionBytes || compactLog();
+}
+
+future<bool> Blockchain::syncLogAsync() {
+    if (logWriter) return logWriter->flush();
+    promise<bool> result; // Without a writer the flush happens right here
+    result.set_value(!log || log->sync());
+    return result.get_future();
+}
+
+bool Blockchain::startLogWriter(size_t queueDepth) {
+    if (!log) return false;
+    logWriterDepth = max<size_t>(queueDepth, 1);
+    logWriter.reset(); // A running writer finishes its queue first
+    logWriter = make_unique<LogWriter>(*log, logWriterDepth);
+    return true;
+}
+
+// The store is flushed before the log is emptied, so a crash in between only leaves blocks that
+// replay skips
+bool Blockchain::compactLog() {
+    // Let a log writer finish first, so no queued block lands in the log after it is emptied
+    if (!syncLogAsync().get() || !releaseStoredBodies() || !store->sync()) return false;
+    return !log || log->reset();
+}
+
+bool Blockchain::releaseStoredBodies() {
+    if (!store || !store->append(chain, [this](uint64_t height) { return unstoredIds(height); },
+                                 [this](uint64_t height) { return unstoredBody(height); })) {
+        return false;
+    }
+    for (; !unstoredBlocks.empty() && unstoredHeight < store->blockCount(); ++unstoredHeight) {
+        unstoredBlocks.pop_front();
+    }
+    for (Block& block : chain) {
+        if (block.bodyLoaded) {
+            block.bodyLoaded = false;
+            BodyPool::global().release(move(block.transactions));
+        }
+    }
+    return true;
 }
@@ -0,0 +1,48 @@
+// src/BloomFilter.cpp
+
+#include "BloomFilter.h"
+
+using namespace std;
+
+// FNV-1a gives the first hash; a splitmix64 finaliser of it gives the second. Positions are
+// h1 + i * h2 (Kirsch-Mitzenmacher double hashing).
+static void itemHashes(const void* data, size_t len, uint64_t& h1, uint64_t& h2) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ull;
+    }
+    h1 = hash;
+    hash += 0x9e3779b97f4a7c15ull;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+    h2 = (hash ^ (hash >> 31)) | 1;
+}
+
+BloomFilter::BloomFilter(size_t expectedItems) : bits((expectedItems * 10 + 63) / 64 + 1, 0) {}
+
+BloomFilter::BloomFilter(vector<uint64_t> words, uint8_t hashCount) : bits(move(words)), hashCount(hashCount) {}
+
+void BloomFilter::add(const void* data, size_t len) {
+    if (bits.empty()) return;
+    uint64_t h1, h2;
+    itemHashes(data, len, h1, h2);
+    const uint64_t size = bits.size() * 64;
+    for (uint8_t i = 0; i < hashCount; ++i) {
+        const uint64_t bit = (h1 + i * h2) % size;
+        bits[bit / 64] |= 1ull << (bit % 64);
+    }
+}
+
+bool BloomFilter::mayContain(const void* data, size_t len) const {
+    if (bits.empty()) return true;
+    uint64_t h1, h2;
+    itemHashes(data, len, h1, h2);
+    const uint64_t size = bits.size() * 64;
+    for (uint8_t i = 0; i < hashCount; ++i) {
+        const uint64_t bit = (h1 + i * h2) % size;
+        if (!(bits[bit / 64] & (1ull << (bit % 64)))) return false;
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+// src/BodyPool.cpp
+
+#include "BodyPool.h"
+#include <algorithm>
+
+using namespace std;
+
+BodyPool& BodyPool::global() {
+    static BodyPool pool;
+    return pool;
+}
+
+BodyPool::BodyPool(size_t budgetBytes) : budgetBytes(budgetBytes) {}
+
+// Best fit: the smallest pooled buffer that is large enough, so big buffers stay for big blocks
+vector<Transaction> BodyPool::acquire(size_t capacity) {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        size_t best = buffers.size();
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            if (buffers[i].capacity() >= capacity &&
+                (best == buffers.size() || buffers[i].capacity() < buffers[best].capacity())) {
+                best = i;
+            }
+        }
+        if (best < buffers.size()) {
+            swap(buffers[best], buffers.back());
+            vector<Transaction> buffer = move(buffers.back());
+            buffers.pop_back();
+            bytes -= buffer.capacity() * sizeof(Transaction);
+            return buffer;
+        }
+    }
+    vector<Transaction> buffer;
+    buffer.reserve(capacity);
+    return buffer;
+}
+
+void BodyPool::release(vector<Transaction>&& body) {
+    vector<Transaction> buffer = move(body);
+    if (buffer.capacity() == 0) return;
+    buffer.clear();
+    const size_t size = buffer.capacity() * sizeof(Transaction);
+    if (size > budgetBytes) return;
+
+    lock_guard<std::mutex> lock(mutex);
+    buffers.push_back(move(buffer));
+    bytes += size;
+    trimToBudget();
+}
+
+size_t BodyPool::pooledBytes() const {
+    lock_guard<std::mutex> lock(mutex);
+    return bytes;
+}
+
+void BodyPool::setBudget(size_t bytes) {
+    lock_guard<std::mutex> lock(mutex);
+    budgetBytes = bytes;
+    trimToBudget();
+}
+
+size_t BodyPool::getBudget() const {
+    lock_guard<std::mutex> lock(mutex);
+    return budgetBytes;
+}
+
+// The smallest buffers go first; they are the cheapest to reallocate
+void BodyPool::trimToBudget() {
+    while (bytes > budgetBytes) {
+        auto smallest = min_element(buffers.begin(), buffers.end(), [](const auto& a, const auto& b) {
+            return a.capacity() < b.capacity();
+        });
+        swap(*smallest, buffers.back());
+        bytes -= buffers.back().capacity() * sizeof(Transaction);
+        buffers.pop_back();
+    }
+}
@@ -0,0 +1,29 @@
+// src/Crc32.cpp
+
+#include "Crc32.h"
+#include <array>
+
+using namespace std;
+
+// Build the byte-at-a-time lookup table for the reflected polynomial
+static array<uint32_t, 256> makeTable() {
+    array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t value = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+        }
+        table[i] = value;
+    }
+    return table;
+}
+
+uint32_t crc32(const void* data, size_t len, uint32_t crc) {
+    static const array<uint32_t, 256> table = makeTable();
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i) {
+        crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
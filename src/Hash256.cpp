@@ -0,0 +1,36 @@
+// src/Hash256.cpp
+
+#include "Hash256.h"
+
+using namespace std;
+
+// Convert the digest to lowercase hex without going through iostreams
+string Hash256::toHex() const {
+    static const char digits[] = "0123456789abcdef";
+    string hex(size() * 2, '0');
+    for (size_t i = 0; i < size(); ++i) {
+        hex[2 * i] = digits[bytes[i] >> 4];
+        hex[2 * i + 1] = digits[bytes[i] & 0x0f];
+    }
+    return hex;
+}
+
+// Decode a single hex digit, returning -1 for anything else
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parse a 64-character hex string into a digest
+bool Hash256::fromHex(const string& hex, Hash256& out) {
+    if (hex.size() != size() * 2) return false;
+    for (size_t i = 0; i < size(); ++i) {
+        int hi = hexValue(hex[2 * i]);
+        int lo = hexValue(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out.bytes[i] = static_cast<uint8_t>(hi << 4 | lo);
+    }
+    return true;
+}
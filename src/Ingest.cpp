@@ -0,0 +1,305 @@
+// src/Ingest.cpp
+
+#include "Ingest.h"
+#include "BodyPool.h"
+#include "BoundedQueue.h"
+#include "MerkleAccumulator.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <string_view>
+#include <thread>
+#include <poll.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// Largest binary record accepted; anything longer means the stream is not in this format
+const uint32_t maxRecordSize = 1 << 20;
+// Input is read in chunks of this many bytes
+const size_t readChunk = 1 << 20;
+// Longest the reader waits for input before checking whether it was asked to stop
+const int readerPollMs = 100;
+
+// Transactions moving through the pipeline; ids are filled in by the hashing stage
+struct Batch {
+    vector<Transaction> transactions;
+    vector<Hash256> ids;
+};
+
+string_view trim(string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r')) text.remove_suffix(1);
+    return text;
+}
+
+bool parseInteger(string_view text, int64_t& value) {
+    if (text.empty()) return false;
+    value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9' || value > (INT64_MAX - 9) / 10) return false;
+        value = value * 10 + (c - '0');
+    }
+    return true;
+}
+
+// Parse "sender,receiver,amount[,timestamp]"; missing timestamps take defaultTimestamp
+bool parseCsvLine(string_view line, int64_t defaultTimestamp, vector<Transaction>& out) {
+    string_view fields[4];
+    size_t count = 0;
+    while (count < 4) {
+        const size_t comma = line.find(',');
+        fields[count++] = trim(line.substr(0, comma));
+        if (comma == string_view::npos) {
+            line = string_view();
+            break;
+        }
+        line.remove_prefix(comma + 1);
+    }
+    if (!line.empty() || count < 3 || fields[0].empty() || fields[1].empty()) return false;
+
+    int64_t amount;
+    int64_t timestamp = defaultTimestamp;
+    if (!Transaction::parseAmount(fields[2], amount)) return false;
+    if (count == 4 && !parseInteger(fields[3], timestamp)) return false;
+    out.emplace_back(fields[0], fields[1], amount, timestamp);
+    return true;
+}
+
+// First stage: read and parse the input, handing batches to the hashing stage
+class Reader {
+public:
+    Reader(int inputFd, const IngestOptions& options, BoundedQueue<Batch>& out)
+        : inputFd(inputFd), options(options), out(out), defaultTimestamp(time(nullptr)) {
+        batch.transactions = BodyPool::global().acquire(options.batchSize);
+    }
+
+    // Reads take whatever the input has ready. When that is nothing, the parsed transactions are
+    // handed on before waiting, so a slow producer (a pipe) still sees its blocks sealed. Waits
+    // are bounded by readerPollMs, so stop() takes effect even while the input is idle.
+    void run() {
+        vector<char> buffer;
+        size_t filled = 0;
+        bool atEnd = false;
+        while (!atEnd && !stopped) {
+            if (!waitForInput()) break;
+            buffer.resize(filled + readChunk);
+            const ssize_t got = ::read(inputFd, buffer.data() + filled, readChunk);
+            if (got < 0) {
+                if (errno == EINTR || errno == EAGAIN) continue;
+                failed = true;
+            } else {
+                bytesRead += static_cast<uint64_t>(got);
+                filled += static_cast<size_t>(got);
+            }
+            atEnd = got <= 0;
+
+            const size_t consumed = options.format == IngestFormat::Csv ? parseCsv(buffer.data(), filled, atEnd)
+                                                                        : parseBinary(buffer.data(), filled, atEnd);
+            memmove(buffer.data(), buffer.data() + consumed, filled - consumed);
+            filled -= consumed;
+        }
+        emit();
+        out.close();
+    }
+
+    // Ask run() to return at its next check; callable from any thread
+    void stop() { stopped = true; }
+
+    // Read by ingest() only after the reader thread is joined
+    uint64_t bytesRead = 0;
+    uint64_t rejected = 0;
+    bool failed = false; // Read error or undecodable stream
+
+private:
+    // Wait until the input has data or has ended; false if the reader was stopped first
+    bool waitForInput() {
+        pollfd ready = {inputFd, POLLIN, 0};
+        if (::poll(&ready, 1, 0) > 0) return true;
+        emit();
+        while (!stopped) {
+            const int result = ::poll(&ready, 1, readerPollMs);
+            if (result > 0 || (result < 0 && errno != EINTR)) return true; // Let read() report errors
+        }
+        return false;
+    }
+
+    // Parse the complete lines in data (and, at the end of input, a final unterminated line)
+    size_t parseCsv(const char* data, size_t size, bool atEnd) {
+        size_t start = 0;
+        while (start < size && !stopped) {
+            const char* newline = static_cast<const char*>(memchr(data + start, '\n', size - start));
+            if (!newline && !atEnd) break;
+            const size_t end = newline ? newline - data : size;
+            string_view line = trim(string_view(data + start, end - start));
+            const bool header = firstLine && line.substr(0, 6) == "sender";
+            firstLine = false;
+            if (!line.empty() && line[0] != '#' && !header) {
+                if (parseCsvLine(line, defaultTimestamp, batch.transactions)) {
+                    if (batch.transactions.size() >= options.batchSize) emit();
+                } else {
+                    ++rejected;
+                }
+            }
+            start = newline ? end + 1 : size;
+        }
+        return start;
+    }
+
+    // Parse the complete records in data; a truncated record at the end of input is rejected
+    size_t parseBinary(const uint8_t* data, size_t size, bool atEnd) {
+        size_t start = 0;
+        while (size - start >= 4 && !stopped) {
+            const uint32_t length = getUint32LE(data + start);
+            if (length > maxRecordSize) { // Lost framing; nothing after this can be trusted
+                failed = true;
+                stopped = true;
+                return size;
+            }
+            if (size - start - 4 < length) break;
+            optional<Transaction> tx = Transaction::decode(data + start + 4, length);
+            if (tx) {
+                batch.transactions.push_back(*tx);
+                if (batch.transactions.size() >= options.batchSize) emit();
+            } else {
+                ++rejected;
+            }
+            start += 4 + length;
+        }
+        if (atEnd && start < size) {
+            ++rejected;
+            start = size;
+        }
+        return start;
+    }
+
+    size_t parseBinary(const char* data, size_t size, bool atEnd) {
+        return parseBinary(reinterpret_cast<const uint8_t*>(data), size, atEnd);
+    }
+
+    void emit() {
+        if (batch.transactions.empty()) return;
+        if (!out.push(move(batch))) stopped = true; // A later stage gave up
+        batch = Batch();
+        batch.transactions = BodyPool::global().acquire(options.batchSize);
+    }
+
+    const int inputFd;
+    const IngestOptions& options;
+    BoundedQueue<Batch>& out;
+    const int64_t defaultTimestamp; // Timestamp for CSV lines without one
+    Batch batch; // Transactions parsed but not handed on yet
+    bool firstLine = true; // A leading "sender,..." line is taken as a header
+    atomic<bool> stopped{false}; // Set by the reader itself or by stop() from ingest()
+};
+
+// Second stage: compute transaction ids with the multi-buffer SHA-256 kernel
+void hashBatches(BoundedQueue<Batch>& in, BoundedQueue<Batch>& out) {
+    while (optional<Batch> batch = in.pop()) {
+        batch->ids.resize(batch->transactions.size());
+        MerkleTree::leafHashes(batch->transactions.data(), batch->transactions.size(), batch->ids.data());
+        if (!out.push(move(*batch))) break;
+    }
+    out.close();
+}
+
+} // namespace
+
+bool ingest(Blockchain& blockchain, int inputFd, const IngestOptions& options, IngestStats& stats) {
+    using Clock = chrono::steady_clock;
+    const auto start = Clock::now();
+    const auto interval = chrono::milliseconds(options.blockIntervalMs);
+    const size_t blockSize = max<size_t>(options.blockSize, 1);
+    const size_t saveEveryBlocks = max<size_t>(options.saveEveryBlocks, 1);
+    // Last stage: the chain's log writer encodes and flushes sealed blocks on a thread of its own
+    if (!blockchain.startLogWriter(options.queueDepth)) return false;
+    if (options.checkBalances) blockchain.setBalanceCheck(true);
+    const StateTree* state = blockchain.getState();
+    if (!state) return false; // The stored chain's balances do not match its state roots
+
+    // Bodies released by a compaction are reused by the blocks after it, so for the run the pool
+    // may keep the pipeline's working set; the usual budget afterwards frees it again
+    BodyPool& pool = BodyPool::global();
+    const size_t idleBudget = pool.getBudget();
+    const size_t inFlight = (saveEveryBlocks + options.queueDepth) * blockSize + 2 * options.queueDepth * options.batchSize;
+    pool.setBudget(max(idleBudget, inFlight * sizeof(Transaction)));
+
+    BoundedQueue<Batch> parsed(options.queueDepth);
+    BoundedQueue<Batch> hashed(options.queueDepth);
+    Reader reader(inputFd, options, parsed);
+    thread readerThread(&Reader::run, &reader);
+    thread hasherThread(hashBatches, ref(parsed), ref(hashed));
+
+    // Third stage, on this thread: fold ids into the accumulator and seal full or overdue blocks
+    vector<Transaction> pending = pool.acquire(blockSize);
+    vector<Hash256> pendingIds; // Ids of pending, for the transaction index
+    pendingIds.reserve(blockSize);
+    MerkleAccumulator leaves;
+    PendingBalances balances(*state); // Balances as of the end of pending
+    Clock::time_point pendingSince;
+    bool ok = true;
+
+    auto seal = [&]() -> bool {
+        const size_t count = pending.size();
+        if (!blockchain.addBlock(move(pending), leaves, pendingIds.data())) return false;
+        pending = pool.acquire(blockSize); // The block kept the old buffer
+        pendingIds.clear();
+        leaves.clear();
+        balances.clear(); // Applied to the chain's state by addBlock
+        ++stats.blocks;
+        stats.transactions += count;
+        return stats.blocks % saveEveryBlocks != 0 || blockchain.compactLog();
+    };
+    auto overdue = [&] {
+        return options.blockIntervalMs > 0 && !pending.empty() && Clock::now() - pendingSince >= interval;
+    };
+
+    while (ok) {
+        optional<Batch> batch;
+        if (options.blockIntervalMs > 0 && !pending.empty()) {
+            batch = hashed.popFor(max(Clock::duration::zero(), pendingSince + interval - Clock::now()));
+        } else {
+            batch = hashed.pop();
+        }
+        if (!batch) {
+            if (hashed.isDrained()) break;
+            if (overdue()) ok = seal(); // Timed out waiting for more input
+            continue;
+        }
+        for (size_t i = 0; ok && i < batch->transactions.size(); ++i) {
+            if (options.checkBalances && !balances.tryApply(batch->transactions[i])) {
+                ++stats.unfunded;
+                continue;
+            }
+            if (pending.empty()) pendingSince = Clock::now();
+            pending.push_back(batch->transactions[i]);
+            pendingIds.push_back(batch->ids[i]);
+            leaves.appendLeaf(batch->ids[i]);
+            if (pending.size() >= blockSize) ok = seal();
+        }
+        pool.release(move(batch->transactions)); // For the reader's next batch
+        if (ok && overdue()) ok = seal();
+    }
+    if (ok && !pending.empty()) ok = seal();
+    if (ok) ok = blockchain.compactLog();
+
+    // On failure, closing the queues makes the earlier stages stop at their next hand-off, and a
+    // reader waiting on idle input sees the stop request within readerPollMs
+    reader.stop();
+    parsed.close();
+    hashed.close();
+    hasherThread.join();
+    readerThread.join();
+
+    pool.setBudget(idleBudget);
+
+    stats.bytesRead = reader.bytesRead;
+    stats.rejected = reader.rejected;
+    stats.seconds = chrono::duration<double>(Clock::now() - start).count();
+    return ok && !reader.failed;
+}
@@ -0,0 +1,74 @@
+// src/LogWriter.cpp
+
+#include "LogWriter.h"
+#include "BodyPool.h"
+#include <chrono>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+// A future is a callback that fulfils a shared promise
+static LogWriter::Callback fulfil(const shared_ptr<promise<bool>>& result) {
+    return [result](bool durable) { result->set_value(durable); };
+}
+
+LogWriter::LogWriter(WriteAheadLog& log, size_t queueDepth)
+    : log(log), queue(queueDepth), writer(&LogWriter::run, this) {}
+
+LogWriter::~LogWriter() {
+    queue.close(); // The writer drains what is left before it stops
+    writer.join();
+}
+
+future<bool> LogWriter::submit(Block&& block) {
+    auto result = make_shared<promise<bool>>();
+    future<bool> acknowledged = result->get_future();
+    submit(move(block), fulfil(result));
+    return acknowledged;
+}
+
+void LogWriter::submit(Block&& block, Callback onDurable) {
+    queue.push(Job{move(block), move(onDurable)});
+}
+
+void LogWriter::submit(Block&& block, Body body, Callback onDurable) {
+    queue.push(Job{move(block), move(onDurable), move(body)});
+}
+
+bool LogWriter::trySubmit(Block& block, Callback onDurable) {
+    Job job{move(block), move(onDurable)};
+    if (queue.tryPush(job)) return true;
+    block = move(*job.block);
+    return false;
+}
+
+future<bool> LogWriter::flush() {
+    auto result = make_shared<promise<bool>>();
+    future<bool> acknowledged = result->get_future();
+    queue.push(Job{nullopt, fulfil(result)});
+    return acknowledged;
+}
+
+void LogWriter::run() {
+    vector<Job> group;
+    while (optional<Job> job = queue.pop()) {
+        group.push_back(move(*job));
+        while (optional<Job> queued = queue.popFor(chrono::seconds(0))) {
+            group.push_back(move(*queued));
+        }
+        for (const Job& member : group) {
+            if (member.block && member.body) {
+                log.append(*member.block, member.body->data(), member.body->size());
+            } else if (member.block) {
+                log.append(*member.block);
+            }
+        }
+        const bool durable = log.sync();
+        for (Job& member : group) {
+            if (member.done) member.done(durable);
+            if (member.block) BodyPool::global().release(move(member.block->transactions));
+        }
+        group.clear();
+    }
+}
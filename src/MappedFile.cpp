@@ -0,0 +1,64 @@
+// src/MappedFile.cpp
+
+#include "MappedFile.h"
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPEDFILE_HAVE_MMAP 1
+#endif
+
+using namespace std;
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const string& path) {
+    close();
+#ifdef MAPPEDFILE_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+    length = static_cast<size_t>(info.st_size);
+    if (length > 0) {
+        void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            ::close(fd);
+            length = 0;
+            return false;
+        }
+        madvise(address, length, MADV_SEQUENTIAL); // Segments are read front to back
+        bytes = static_cast<const uint8_t*>(address);
+        mapped = true;
+    }
+    ::close(fd); // The mapping stays valid after the descriptor is closed
+    return true;
+#else
+    ifstream file(path, ios::binary | ios::ate);
+    if (!file.is_open()) return false;
+    length = static_cast<size_t>(file.tellg());
+    buffer.resize(length);
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(buffer.data()), length);
+    bytes = buffer.data();
+    return static_cast<bool>(file);
+#endif
+}
+
+void MappedFile::close() {
+#ifdef MAPPEDFILE_HAVE_MMAP
+    if (mapped) munmap(const_cast<uint8_t*>(bytes), length);
+#endif
+    buffer.clear();
+    bytes = nullptr;
+    length = 0;
+    mapped = false;
+}
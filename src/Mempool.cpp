@@ -0,0 +1,103 @@
+// src/Mempool.cpp
+
+#include "Mempool.h"
+#include "BodyPool.h"
+#include "MerkleTree.h"
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <utility>
+
+using namespace std;
+
+bool Mempool::add(const Transaction& transaction) {
+    return insert(MerkleTree::leafHash(transaction), Transaction(transaction));
+}
+
+bool Mempool::add(Transaction&& transaction) {
+    const Hash256 id = MerkleTree::leafHash(transaction);
+    return insert(id, move(transaction));
+}
+
+// The id is hashed before taking the lock; only the shard's bookkeeping happens under it.
+// The sequence number is drawn under the shard lock so each shard's deque stays ordered.
+bool Mempool::insert(const Hash256& id, Transaction&& transaction) {
+    Shard& shard = shardFor(id);
+    lock_guard<mutex> lock(shard.mutex);
+    if (!shard.ids.insert(id).second) return false; // Already pending
+    shard.entries.push_back({nextSequence.fetch_add(1, memory_order_relaxed), id, move(transaction)});
+    pending.fetch_add(1, memory_order_relaxed);
+    return true;
+}
+
+// Every shard is locked (in index order, so this cannot deadlock with another drain) and the
+// shard fronts are merged by sequence number, oldest first
+vector<Transaction> Mempool::drainBatch(size_t maxTx) {
+    vector<unique_lock<mutex>> locks;
+    locks.reserve(shardCount);
+    for (Shard& shard : shards) locks.emplace_back(shard.mutex);
+
+    using Front = pair<uint64_t, size_t>; // (sequence, shard)
+    priority_queue<Front, vector<Front>, greater<Front>> fronts;
+    size_t available = 0;
+    for (size_t s = 0; s < shardCount; ++s) {
+        if (!shards[s].entries.empty()) fronts.push({shards[s].entries.front().sequence, s});
+        available += shards[s].entries.size();
+    }
+
+    vector<Transaction> batch = BodyPool::global().acquire(min(maxTx, available));
+    while (batch.size() < maxTx && !fronts.empty()) {
+        Shard& shard = shards[fronts.top().second];
+        fronts.pop();
+        Entry& entry = shard.entries.front();
+        shard.ids.erase(entry.id);
+        batch.push_back(move(entry.transaction));
+        shard.entries.pop_front();
+        if (!shard.entries.empty()) fronts.push({shard.entries.front().sequence, &shard - shards});
+    }
+    pending.fetch_sub(batch.size(), memory_order_relaxed);
+    return batch;
+}
+
+vector<Transaction> Mempool::snapshot() const {
+    vector<pair<uint64_t, const Transaction*>> ordered;
+    vector<unique_lock<mutex>> locks;
+    locks.reserve(shardCount);
+    for (const Shard& shard : shards) {
+        locks.emplace_back(shard.mutex);
+        for (const Entry& entry : shard.entries) ordered.push_back({entry.sequence, &entry.transaction});
+    }
+    sort(ordered.begin(), ordered.end(),
+         [](const pair<uint64_t, const Transaction*>& a, const pair<uint64_t, const Transaction*>& b) {
+             return a.first < b.first;
+         });
+
+    vector<Transaction> transactions;
+    transactions.reserve(ordered.size());
+    for (const auto& item : ordered) transactions.push_back(*item.second);
+    return transactions;
+}
+
+bool Mempool::contains(const Hash256& txId) const {
+    const Shard& shard = shardFor(txId);
+    lock_guard<mutex> lock(shard.mutex);
+    return shard.ids.count(txId) != 0;
+}
+
+size_t Mempool::size() const {
+    return pending.load(memory_order_relaxed);
+}
+
+bool Mempool::empty() const {
+    return size() == 0;
+}
+
+// Ids are SHA-256 digests, so any byte spreads evenly over the shards. The last byte is used
+// because std::hash<Hash256> (the first word) already places ids inside each shard's set.
+Mempool::Shard& Mempool::shardFor(const Hash256& id) {
+    return shards[id.bytes[Hash256::size() - 1] % shardCount];
+}
+
+const Mempool::Shard& Mempool::shardFor(const Hash256& id) const {
+    return shards[id.bytes[Hash256::size() - 1] % shardCount];
+}
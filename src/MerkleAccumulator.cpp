@@ -0,0 +1,45 @@
+// src/MerkleAccumulator.cpp
+
+#include "MerkleAccumulator.h"
+#include "MerkleTree.h"
+
+using namespace std;
+
+void MerkleAccumulator::append(const Transaction& transaction) {
+    appendLeaf(MerkleTree::leafHash(transaction));
+}
+
+// Like incrementing a binary counter: every complete subtree of equal size to the left is
+// merged with the new one, and the result lands on the first free level
+void MerkleAccumulator::appendLeaf(const Hash256& leafHash) {
+    Hash256 carry = leafHash;
+    size_t level = 0;
+    while (count >> level & 1) {
+        carry = MerkleTree::hashPair(frontier[level], carry);
+        ++level;
+    }
+    if (level == frontier.size()) frontier.emplace_back();
+    frontier[level] = carry;
+    ++count;
+}
+
+// The smallest subtree sits rightmost; each larger one to its left becomes the left child
+Hash256 MerkleAccumulator::getRootHash() const {
+    Hash256 root;
+    bool haveRoot = false;
+    for (size_t level = 0; level < frontier.size(); ++level) {
+        if (!(count >> level & 1)) continue;
+        root = haveRoot ? MerkleTree::hashPair(frontier[level], root) : frontier[level];
+        haveRoot = true;
+    }
+    return root;
+}
+
+size_t MerkleAccumulator::leafCount() const {
+    return count;
+}
+
+void MerkleAccumulator::clear() {
+    frontier.clear();
+    count = 0;
+}
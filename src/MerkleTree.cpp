@@ -1,63 +1,206 @@
 #include "MerkleTree.h"
 #include "sha256.h"  // Use your custom sha256 header
-#include <sstream>    // For stringstream
-#include <iomanip>    // For setw, setfill, and hex
+#include "ThreadPool.h"
+#include "Metrics.h"
+#include <algorithm>
+
+// calc_sha_256_many writes digests back to back, which relies on Hash256 having no padding
+static_assert(sizeof(Hash256) == SIZE_OF_SHA_256_HASH, "Hash256 must be exactly one digest");
 
 using namespace std;
 
-// Constructor for MerkleNode
-MerkleNode::MerkleNode(const string& hash) : hash(hash), left(nullptr), right(nullptr) {}
+// Transaction count from which buildTree spreads work over the shared thread pool
+atomic<size_t> MerkleTree::parallelThreshold{4096};
+
+// Leaves and pairs are handed to the pool in chunks of this many hashes
+static const size_t hashBatch = 1024;
+
+// Hash the leaves [begin, end) in one multi-buffer batch. The canonical encodings are laid out
+// back to back in a single buffer, so a whole batch costs one allocation instead of one per leaf.
+static void hashLeaves(const Transaction* transactions, Hash256* out, size_t begin, size_t end) {
+    const size_t count = end - begin;
+    vector<size_t> lengths(count);
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        lengths[i] = transactions[begin + i].encodedSize();
+        total += lengths[i];
+    }
+
+    vector<uint8_t> encoded(total);
+    vector<const void*> inputs(count);
+    uint8_t* pos = encoded.data();
+    for (size_t i = 0; i < count; ++i) {
+        inputs[i] = pos;
+        pos = transactions[begin + i].encode(pos);
+    }
+    calc_sha_256_many(out[begin].data(), inputs.data(), lengths.data(), count);
+    METRIC_ADD(sha256Calls, count);
+    METRIC_ADD(sha256Bytes, total);
+}
+
+// Hash the sibling pairs [begin, end) of a level into their parents. Siblings are adjacent in
+// the buffer, so each pair is hashed in place as one 64-byte message.
+static void hashPairs(const Hash256* below, Hash256* parents, size_t begin, size_t end) {
+    const size_t count = end - begin;
+    vector<const void*> inputs(count);
+    vector<size_t> lengths(count, 2 * sizeof(Hash256));
+    for (size_t i = 0; i < count; ++i) {
+        inputs[i] = below[2 * (begin + i)].data(); // Combine pairs of nodes to create a new parent node
+    }
+    calc_sha_256_many(parents[begin].data(), inputs.data(), lengths.data(), count);
+    METRIC_ADD(sha256Calls, count);
+    METRIC_ADD(sha256Bytes, count * 2 * sizeof(Hash256));
+}
 
 // Constructor for MerkleTree
 MerkleTree::MerkleTree(const vector<Transaction>& transactions) {
-    root = buildTree(transactions); // Build the tree from transactions
+    buildTree(transactions); // Build the tree from transactions
 }
 
 // Build the Merkle tree from the provided transactions
-shared_ptr<MerkleNode> MerkleTree::buildTree(const vector<Transaction>& transactions) {
-    vector<shared_ptr<MerkleNode>> nodes;
-
-    // Create leaf nodes for each transaction
-    for (const auto& tx : transactions) {
-        nodes.push_back(make_shared<MerkleNode>(hash(tx.serialize())));
-    }
-
-    // Build the tree
-    while (nodes.size() > 1) {
-        vector<shared_ptr<MerkleNode>> newLevel;
-        for (size_t i = 0; i < nodes.size(); i += 2) {
-            // Combine pairs of nodes to create a new parent node
-            if (i + 1 < nodes.size()) {
-                string combinedHash = nodes[i]->hash + nodes[i + 1]->hash;
-                newLevel.push_back(make_shared<MerkleNode>(hash(combinedHash)));
-                newLevel.back()->left = nodes[i];
-                newLevel.back()->right = nodes[i + 1];
-            } else {
-                newLevel.push_back(nodes[i]); // Handle odd number of nodes
-            }
+void MerkleTree::buildTree(const vector<Transaction>& transactions) {
+    METRIC_TIME(merkleBuildNanos);
+    nodes.clear();
+    levelOffsets.clear();
+
+    // Work out the size of every level up front so the buffer is allocated once
+    size_t total = 0;
+    size_t width = transactions.size();
+    levelOffsets.push_back(0);
+    while (width > 0) {
+        total += width;
+        levelOffsets.push_back(total);
+        if (width == 1) break;
+        width = (width + 1) / 2;
+    }
+    nodes.resize(total);
+    METRIC_ADD(merkleBuilds, 1);
+    METRIC_ADD(merkleNodes, total);
+
+    // Large blocks use the shared pool for the leaves and for every level still wide enough to
+    // split. Each hash lands in a fixed slot, so the result matches the serial build exactly.
+    ThreadPool& pool = ThreadPool::shared();
+    const bool parallel = transactions.size() >= parallelThreshold && pool.size() > 0;
+
+    // Hash the leaves in batches through the multi-buffer SHA-256 kernel
+    if (parallel) {
+        pool.parallelFor(transactions.size(), hashBatch, [&](size_t begin, size_t end) {
+            hashLeaves(transactions.data(), nodes.data(), begin, end);
+        });
+    } else {
+        for (size_t start = 0; start < transactions.size(); start += hashBatch) {
+            hashLeaves(transactions.data(), nodes.data(), start, min(transactions.size(), start + hashBatch));
         }
-        nodes = newLevel; // Move to the next level
     }
-    return nodes.empty() ? nullptr : nodes[0]; // Return root node
+
+    // Build each level from the one below it
+    for (size_t level = 0; level + 2 < levelOffsets.size(); ++level) {
+        const Hash256* below = &nodes[levelOffsets[level]];
+        const size_t count = levelOffsets[level + 1] - levelOffsets[level];
+        Hash256* parents = &nodes[levelOffsets[level + 1]];
+        const size_t pairs = count / 2;
+        if (parallel && pairs > hashBatch) {
+            pool.parallelFor(pairs, hashBatch, [&](size_t begin, size_t end) {
+                hashPairs(below, parents, begin, end);
+            });
+        } else {
+            hashPairs(below, parents, 0, pairs);
+        }
+        if (count % 2 == 1) {
+            parents[pairs] = below[count - 1]; // Handle odd number of nodes
+        }
+    }
+}
+
+void MerkleTree::setParallelThreshold(size_t txCount) {
+    parallelThreshold = txCount;
+}
+
+size_t MerkleTree::getParallelThreshold() {
+    return parallelThreshold;
 }
 
-// Compute the SHA256 hash of the given data using your custom calc_sha_256 function
-string MerkleTree::hash(const string& data) const {
-    uint8_t hash[SIZE_OF_SHA_256_HASH];  // Declare the hash array
-    
-    // Call the custom SHA-256 function
-    calc_sha_256(hash, data.c_str(), data.size());
+// Compute the leaf hash of a transaction by streaming its canonical encoding into SHA-256
+Hash256 MerkleTree::leafHash(const Transaction& transaction) {
+    Hash256 digest;
+    struct Sha_256 sha;
+    sha_256_init(&sha, digest.data());
+    size_t bytes = 0;
+    transaction.writeCanonical([&sha, &bytes](const void* data, size_t len) {
+        sha_256_write(&sha, data, len);
+        bytes += len;
+    });
+    sha_256_close(&sha);
+    METRIC_ADD(sha256Calls, 1);
+    METRIC_ADD(sha256Bytes, bytes);
+    return digest;
+}
 
-    // Convert hash to hexadecimal string using stringstream
-    stringstream ss;
-    for (int i = 0; i < SIZE_OF_SHA_256_HASH; ++i) {
-        ss << hex << setw(2) << setfill('0') << (int)hash[i];
+void MerkleTree::leafHashes(const Transaction* transactions, size_t count, Hash256* out) {
+    for (size_t start = 0; start < count; start += hashBatch) {
+        hashLeaves(transactions, out, start, min(count, start + hashBatch));
     }
-    
-    return ss.str();
+}
+
+// Hash the 64-byte concatenation of two child digests
+Hash256 MerkleTree::hashPair(const Hash256& left, const Hash256& right) {
+    uint8_t combined[2 * SIZE_OF_SHA_256_HASH];
+    memcpy(combined, left.data(), SIZE_OF_SHA_256_HASH);
+    memcpy(combined + SIZE_OF_SHA_256_HASH, right.data(), SIZE_OF_SHA_256_HASH);
+
+    Hash256 digest;
+    calc_sha_256(digest.data(), combined, sizeof(combined));
+    METRIC_ADD(sha256Calls, 1);
+    METRIC_ADD(sha256Bytes, sizeof(combined));
+    return digest;
 }
 
 // Get the root hash of the Merkle tree
-string MerkleTree::getRootHash() const {
-    return root ? root->hash : ""; // Return empty if root is null
+Hash256 MerkleTree::getRootHash() const {
+    return nodes.empty() ? Hash256() : nodes.back(); // Return all-zero hash for an empty tree
+}
+
+size_t MerkleTree::leafCount() const {
+    return levelSize(0);
+}
+
+size_t MerkleTree::levelCount() const {
+    return levelOffsets.empty() ? 0 : levelOffsets.size() - 1;
+}
+
+size_t MerkleTree::levelSize(size_t level) const {
+    return level < levelCount() ? levelOffsets[level + 1] - levelOffsets[level] : 0;
+}
+
+const Hash256& MerkleTree::node(size_t level, size_t position) const {
+    return nodes[levelOffsets[level] + position];
+}
+
+const Hash256* MerkleTree::leafData() const {
+    return nodes.data(); // Leaves are the first level in the buffer
+}
+
+// Collect the sibling path for a leaf, walking up one level at a time
+MerkleProof MerkleTree::getProof(size_t txIndex) const {
+    MerkleProof proof;
+    if (txIndex >= leafCount()) return proof;
+
+    size_t position = txIndex;
+    for (size_t level = 0; level + 1 < levelCount(); ++level) {
+        const size_t sibling = position ^ 1;
+        if (sibling < levelSize(level)) {
+            proof.push_back({node(level, sibling), sibling < position});
+        }
+        position /= 2;
+    }
+    return proof;
+}
+
+// Recompute the root from a leaf and its sibling path
+bool MerkleTree::verifyProof(const Hash256& leafHash, const MerkleProof& proof, const Hash256& root) {
+    Hash256 current = leafHash;
+    for (const MerkleProofStep& step : proof) {
+        current = step.siblingOnLeft ? hashPair(step.sibling, current) : hashPair(current, step.sibling);
+    }
+    return current == root;
 }
@@ -0,0 +1,162 @@
+// src/Metrics.cpp
+
+#include "Metrics.h"
+#include <cstdio>
+
+using namespace std;
+
+// Threads take slots round robin the first time they count
+static size_t threadSlot() {
+    static atomic<size_t> nextSlot{0};
+    thread_local const size_t slot = nextSlot.fetch_add(1, memory_order_relaxed) % Counter::slotCount;
+    return slot;
+}
+
+void Counter::add(uint64_t n) {
+    slots[threadSlot()].value.fetch_add(n, memory_order_relaxed);
+}
+
+uint64_t Counter::value() const {
+    uint64_t sum = 0;
+    for (const Slot& slot : slots) sum += slot.value.load(memory_order_relaxed);
+    return sum;
+}
+
+void Counter::reset() {
+    for (Slot& slot : slots) slot.value.store(0, memory_order_relaxed);
+}
+
+void Histogram::record(uint64_t nanos) {
+    // Bucket k holds (2^(minExponent+k-1), 2^(minExponent+k)]
+    size_t k = 0;
+    while (k < bucketCount && nanos > bucketBound(k)) ++k;
+    if (k < bucketCount) buckets[k].fetch_add(1, memory_order_relaxed);
+    total.fetch_add(1, memory_order_relaxed);
+    nanosSum.fetch_add(nanos, memory_order_relaxed);
+}
+
+uint64_t Histogram::count() const {
+    return total.load(memory_order_relaxed);
+}
+
+uint64_t Histogram::sum() const {
+    return nanosSum.load(memory_order_relaxed);
+}
+
+uint64_t Histogram::bucket(size_t k) const {
+    return buckets[k].load(memory_order_relaxed);
+}
+
+uint64_t Histogram::bucketBound(size_t k) {
+    return uint64_t(1) << (minExponent + k);
+}
+
+void Histogram::reset() {
+    for (auto& b : buckets) b.store(0, memory_order_relaxed);
+    total.store(0, memory_order_relaxed);
+    nanosSum.store(0, memory_order_relaxed);
+}
+
+Metrics& Metrics::global() {
+    static Metrics metrics;
+    return metrics;
+}
+
+// Names and help text shared by both export formats
+namespace {
+struct CounterInfo {
+    const char* name;
+    const char* help;
+    Counter Metrics::*member;
+};
+struct HistogramInfo {
+    const char* name;
+    const char* help;
+    Histogram Metrics::*member;
+};
+
+const CounterInfo counters[] = {
+    {"blockchain_sha256_calls_total", "SHA-256 digests computed", &Metrics::sha256Calls},
+    {"blockchain_sha256_bytes_total", "Message bytes hashed with SHA-256", &Metrics::sha256Bytes},
+    {"blockchain_merkle_builds_total", "Merkle trees built", &Metrics::merkleBuilds},
+    {"blockchain_merkle_nodes_total", "Nodes in the Merkle trees built", &Metrics::merkleNodes},
+    {"blockchain_store_blocks_written_total", "Blocks appended to the block store", &Metrics::storeBlocksWritten},
+    {"blockchain_store_bytes_written_total", "Record bytes appended to the block store", &Metrics::storeBytesWritten},
+    {"blockchain_store_blocks_read_total", "Blocks decoded from the block store", &Metrics::storeBlocksRead},
+    {"blockchain_store_bytes_read_total", "Record bytes decoded from the block store", &Metrics::storeBytesRead},
+    {"blockchain_wal_records_total", "Blocks appended to the write-ahead log", &Metrics::walRecords},
+    {"blockchain_wal_syncs_total", "Group commits of the write-ahead log", &Metrics::walSyncs},
+    {"blockchain_wal_bytes_total", "Record bytes written to the write-ahead log", &Metrics::walBytes},
+};
+
+const HistogramInfo histograms[] = {
+    {"blockchain_merkle_build_seconds", "Time to build a Merkle tree", &Metrics::merkleBuildNanos},
+    {"blockchain_add_block_seconds", "Time to seal (and mine) a new block", &Metrics::addBlockNanos},
+    {"blockchain_validate_block_seconds", "Time to validate one block", &Metrics::validateBlockNanos},
+    {"blockchain_store_append_seconds", "Time to append new blocks to the block store", &Metrics::storeAppendNanos},
+    {"blockchain_store_load_seconds", "Time to load the block store", &Metrics::storeLoadNanos},
+    {"blockchain_wal_sync_seconds", "Time to write and flush one group of log records", &Metrics::walSyncNanos},
+};
+
+string formatDouble(double value) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.9g", value);
+    return text;
+}
+} // namespace
+
+string Metrics::toPrometheus() const {
+    string out;
+    for (const CounterInfo& info : counters) {
+        out += string("# HELP ") + info.name + " " + info.help + "\n";
+        out += string("# TYPE ") + info.name + " counter\n";
+        out += string(info.name) + " " + to_string((this->*info.member).value()) + "\n";
+    }
+    for (const HistogramInfo& info : histograms) {
+        const Histogram& histogram = this->*info.member;
+        out += string("# HELP ") + info.name + " " + info.help + "\n";
+        out += string("# TYPE ") + info.name + " histogram\n";
+        uint64_t cumulative = 0;
+        for (size_t k = 0; k < Histogram::bucketCount; ++k) {
+            cumulative += histogram.bucket(k);
+            out += string(info.name) + "_bucket{le=\"" + formatDouble(Histogram::bucketBound(k) / 1e9) + "\"} " +
+                   to_string(cumulative) + "\n";
+        }
+        out += string(info.name) + "_bucket{le=\"+Inf\"} " + to_string(histogram.count()) + "\n";
+        out += string(info.name) + "_sum " + formatDouble(histogram.sum() / 1e9) + "\n";
+        out += string(info.name) + "_count " + to_string(histogram.count()) + "\n";
+    }
+    return out;
+}
+
+string Metrics::toJson() const {
+    string out = "{\"enabled\": ";
+    out += METRICS_ENABLED ? "true" : "false";
+    out += ", \"counters\": {";
+    for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); ++i) {
+        if (i > 0) out += ", ";
+        out += string("\"") + counters[i].name + "\": " + to_string((this->*counters[i].member).value());
+    }
+    out += "}, \"histograms\": {";
+    for (size_t i = 0; i < sizeof(histograms) / sizeof(histograms[0]); ++i) {
+        const Histogram& histogram = this->*histograms[i].member;
+        if (i > 0) out += ", ";
+        out += string("\"") + histograms[i].name + "\": {\"count\": " + to_string(histogram.count()) +
+               ", \"sum_seconds\": " + formatDouble(histogram.sum() / 1e9) + ", \"buckets\": {";
+        bool first = true;
+        for (size_t k = 0; k < Histogram::bucketCount; ++k) {
+            if (histogram.bucket(k) == 0) continue;
+            if (!first) out += ", ";
+            first = false;
+            out += "\"" + formatDouble(Histogram::bucketBound(k) / 1e9) + "\": " + to_string(histogram.bucket(k));
+        }
+        out += "}}";
+    }
+    out += "}}";
+    return out;
+}
+
+void Metrics::reset() {
+    for (const CounterInfo& info : counters) (this->*info.member).reset();
+    for (const HistogramInfo& info : histograms) (this->*info.member).reset();
+}
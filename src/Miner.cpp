@@ -0,0 +1,126 @@
+// src/Miner.cpp
+
+#include "Miner.h"
+#include "Blockchain.h"
+#include "ByteOrder.h"
+#include "Metrics.h"
+#include "sha256.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// The midstate trick needs every fixed byte before the nonce to fit in one chunk after the
+// first, and the nonce to end the header
+static_assert(Block::nonceOffset + 8 == Block::headerSize, "nonce must be the last header field");
+static_assert(Block::headerSize - SIZE_OF_SHA_256_CHUNK <= SIZE_OF_SHA_256_CHUNK - 9,
+              "header tail and padding must fit in one chunk");
+
+// How many attempts a thread makes between checks of the stop flag
+static const uint64_t checkInterval = 4096;
+
+Miner::Miner(size_t threadCount)
+    : threadCount(threadCount > 0 ? threadCount : max(1u, thread::hardware_concurrency())) {}
+
+void Miner::skip() {
+    ++searches;
+}
+
+uint64_t Miner::nextSearch() const {
+    return searches + 1;
+}
+
+void Miner::cancel() {
+    if (searching) cancel(searches);
+}
+
+static_assert(atomic<uint64_t>::is_always_lock_free, "cancel must be safe to call from a signal handler");
+
+// Searches run in order, so raising the mark never cancels one that has already finished
+void Miner::cancel(uint64_t search) {
+    uint64_t current = cancelledThrough;
+    while (current < search && !cancelledThrough.compare_exchange_weak(current, search)) {
+    }
+}
+
+// True if the hash starts with at least `difficulty` zero bits
+bool Miner::meetsDifficulty(const Hash256& hash, uint32_t difficulty) {
+    if (difficulty > 8 * hash.size()) return false;
+    const uint32_t fullBytes = difficulty / 8;
+    for (uint32_t i = 0; i < fullBytes; ++i) {
+        if (hash.bytes[i] != 0) return false;
+    }
+    const uint32_t remainingBits = difficulty % 8;
+    return remainingBits == 0 || (hash.bytes[fullBytes] >> (8 - remainingBits)) == 0;
+}
+
+MiningResult Miner::mine(Block& block) {
+    MiningResult result;
+    const uint64_t number = searches + 1;
+    searches = number;
+    searching = true;
+    const auto start = chrono::steady_clock::now();
+
+    // Stream the fixed part of the header once: the first chunk is compressed into the midstate
+    // and the rest of the prefix waits in the chunk buffer
+    uint8_t header[Block::headerSize];
+    block.encodeHeader(header);
+    uint8_t unused[SIZE_OF_SHA_256_HASH];
+    struct Sha_256 midstate;
+    sha_256_init(&midstate, unused);
+    sha_256_write(&midstate, header, Block::nonceOffset);
+
+    atomic<bool> found{false};
+    atomic<uint64_t> winningNonce{0};
+    atomic<uint64_t> attempts{0};
+    const uint32_t difficulty = block.difficulty;
+
+    // Each thread scans its own contiguous slice of the 64-bit nonce space
+    const uint64_t slice = UINT64_MAX / threadCount;
+    auto search = [&](size_t t) {
+        uint64_t nonce = t * slice;
+        const uint64_t end = t + 1 == threadCount ? UINT64_MAX : nonce + slice;
+        uint64_t tried = 0;
+        Hash256 digest;
+        uint8_t nonceBytes[8];
+        struct Sha_256 attempt;
+        while (nonce < end) {
+            if (tried % checkInterval == 0 && (found || cancelledThrough >= number)) break;
+            sha_256_clone(&attempt, &midstate, digest.data());
+            putUint64LE(nonceBytes, nonce);
+            sha_256_write(&attempt, nonceBytes, sizeof(nonceBytes));
+            sha_256_close(&attempt);
+            ++tried;
+            if (meetsDifficulty(digest, difficulty)) {
+                if (!found.exchange(true)) winningNonce = nonce;
+                break;
+            }
+            ++nonce;
+        }
+        attempts += tried;
+    };
+
+    vector<thread> threads;
+    for (size_t t = 1; t < threadCount; ++t) {
+        threads.emplace_back(search, t);
+    }
+    search(0);
+    for (thread& th : threads) {
+        th.join();
+    }
+    searching = false;
+
+    result.found = found;
+    result.attempts = attempts;
+    METRIC_ADD(sha256Calls, result.attempts);
+    METRIC_ADD(sha256Bytes, result.attempts * Block::headerSize);
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    result.hashesPerSecond = result.seconds > 0 ? result.attempts / result.seconds : 0;
+    if (result.found) {
+        result.nonce = winningNonce;
+        block.setNonce(result.nonce);
+    }
+    return result;
+}
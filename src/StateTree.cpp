@@ -0,0 +1,393 @@
+// src/StateTree.cpp
+
+#include "StateTree.h"
+#include "AccountRegistry.h"
+#include "ByteOrder.h"
+#include "Metrics.h"
+#include "sha256.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+using namespace std;
+
+static const size_t leafMessageSize = 1 + 32 + 8;
+static const size_t nodeMessageSize = 1 + 2 * 32;
+
+// Pending change to one leaf during apply
+struct Update {
+    uint64_t prefix; // First 64 bits of the key, enough to order updates along the tree
+    Hash256 key;
+    int64_t balance;
+};
+
+// Bit `depth` of key, counting from the most significant bit of the first byte
+static int keyBit(const Hash256& key, size_t depth) {
+    return (key.bytes[depth / 8] >> (7 - depth % 8)) & 1;
+}
+
+static uint64_t keyPrefix(const Hash256& key) {
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < 8; ++i) prefix = prefix << 8 | key.bytes[i];
+    return prefix;
+}
+
+static void encodeLeaf(uint8_t* out, const Hash256& key, int64_t balance) {
+    out[0] = 0x00;
+    memcpy(out + 1, key.data(), 32);
+    putUint64LE(out + 33, static_cast<uint64_t>(balance));
+}
+
+static void encodeNode(uint8_t* out, const Hash256& left, const Hash256& right) {
+    out[0] = 0x01;
+    memcpy(out + 1, left.data(), 32);
+    memcpy(out + 33, right.data(), 32);
+}
+
+static Hash256 digest(const uint8_t* message, size_t size) {
+    Hash256 hash;
+    calc_sha_256(hash.data(), message, size);
+    METRIC_ADD(sha256Calls, 1);
+    METRIC_ADD(sha256Bytes, size);
+    return hash;
+}
+
+// a + b, or false if it does not fit
+static bool addChecked(int64_t a, int64_t b, int64_t& sum) {
+    if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b)) return false;
+    sum = a + b;
+    return true;
+}
+
+static bool subtractChecked(int64_t a, int64_t b, int64_t& difference) {
+    if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b)) return false;
+    difference = a - b;
+    return true;
+}
+
+StateTree::StateTree() : issuerId(AccountRegistry::global().intern(issuer)) {}
+
+Hash256 StateTree::accountKey(string_view account) {
+    return digest(reinterpret_cast<const uint8_t*>(account.data()), account.size());
+}
+
+const Hash256& StateTree::keyOf(uint32_t accountId) const {
+    if (accountId >= keysById.size()) {
+        keysById.resize(accountId + 1);
+        keyKnown.resize(accountId + 1);
+    }
+    if (!keyKnown[accountId]) {
+        keysById[accountId] = accountKey(AccountRegistry::global().name(accountId));
+        keyKnown[accountId] = true;
+    }
+    return keysById[accountId];
+}
+
+const Hash256& StateTree::rootHash() const {
+    return root;
+}
+
+size_t StateTree::accountCount() const {
+    return leaves.size();
+}
+
+bool StateTree::balance(const Hash256& key, int64_t& value) const {
+    auto found = leaves.find(key);
+    if (found == leaves.end()) return false;
+    value = balances[found->second];
+    return true;
+}
+
+int64_t StateTree::balanceOf(uint32_t accountId) const {
+    int64_t value = 0;
+    if (accountId != issuerId) balance(keyOf(accountId), value);
+    return value;
+}
+
+// Transfers are checked against running balances first, so a rejected batch never touches the tree
+bool StateTree::apply(const vector<Transaction>& transactions, bool checkFunds, size_t* failed) {
+    PendingBalances pending(*this, checkFunds);
+    for (size_t i = 0; i < transactions.size(); ++i) {
+        if (!pending.tryApply(transactions[i])) {
+            if (failed) *failed = i;
+            return false;
+        }
+    }
+
+    journal.clear();
+    journal.reserve(pending.balances.size());
+    vector<Update> updates;
+    updates.reserve(pending.balances.size());
+    for (const auto& [accountId, entry] : pending.balances) {
+        if (entry.after == entry.before) continue; // Only looked at
+        const Hash256& key = keyOf(accountId);
+        journal.push_back({key, entry.before});
+        updates.push_back({keyPrefix(key), key, entry.after});
+    }
+    // In key order, consecutive updates share the upper part of their paths while it is cached
+    sort(updates.begin(), updates.end(), [](const Update& a, const Update& b) { return a.prefix < b.prefix; });
+    for (const Update& update : updates) {
+        if (update.balance == 0) {
+            erase(update.key);
+        } else {
+            set(update.key, update.balance);
+        }
+    }
+    rehash();
+    return true;
+}
+
+void StateTree::undo() {
+    for (const Change& change : journal) {
+        if (change.balance != 0) {
+            set(change.key, change.balance);
+        } else {
+            erase(change.key);
+        }
+    }
+    journal.clear();
+    rehash();
+}
+
+void StateTree::clear() {
+    nodes.clear();
+    hashes.clear();
+    keys.clear();
+    balances.clear();
+    freeNodes.clear();
+    rootNode = none;
+    root = Hash256();
+    leaves.clear();
+    journal.clear();
+}
+
+uint32_t StateTree::newNode() {
+    if (!freeNodes.empty()) {
+        const uint32_t index = freeNodes.back();
+        freeNodes.pop_back();
+        nodes[index] = Node();
+        return index;
+    }
+    nodes.emplace_back();
+    hashes.emplace_back();
+    keys.emplace_back();
+    balances.emplace_back();
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void StateTree::set(const Hash256& key, int64_t value) {
+    // Walk down to the leaf or empty slot on key's path
+    uint32_t parent = none;
+    int side = 0;
+    size_t depth = 0;
+    uint32_t current = rootNode;
+    while (current != none && !nodes[current].leaf) {
+        nodes[current].dirty = true;
+        parent = current;
+        side = keyBit(key, depth++);
+        current = nodes[current].children[side];
+    }
+    if (current != none && keys[current] == key) {
+        balances[current] = value;
+        nodes[current].dirty = true;
+        return;
+    }
+
+    const uint32_t leaf = newNode();
+    nodes[leaf].leaf = true;
+    keys[leaf] = key;
+    balances[leaf] = value;
+    leaves[key] = leaf;
+
+    // Another account's leaf sits in the way: add internal nodes down to the first bit where
+    // the two keys differ, with one leaf on each side of the last
+    uint32_t attach = leaf;
+    if (current != none) {
+        const Hash256 otherKey = keys[current];
+        size_t splitDepth = depth;
+        while (keyBit(key, splitDepth) == keyBit(otherKey, splitDepth)) ++splitDepth;
+        uint32_t below = newNode();
+        nodes[below].children[keyBit(key, splitDepth)] = leaf;
+        nodes[below].children[keyBit(otherKey, splitDepth)] = current;
+        for (size_t d = splitDepth; d > depth; --d) {
+            const uint32_t above = newNode();
+            nodes[above].children[keyBit(key, d - 1)] = below;
+            below = above;
+        }
+        attach = below;
+    }
+    if (parent == none) {
+        rootNode = attach;
+    } else {
+        nodes[parent].children[side] = attach;
+    }
+}
+
+void StateTree::erase(const Hash256& key) {
+    vector<uint32_t> path; // Internal nodes from the root down to the leaf's parent
+    uint32_t current = rootNode;
+    while (current != none && !nodes[current].leaf) {
+        nodes[current].dirty = true;
+        path.push_back(current);
+        current = nodes[current].children[keyBit(key, path.size() - 1)];
+    }
+    if (current == none || keys[current] != key) return;
+    leaves.erase(key);
+    freeNodes.push_back(current);
+
+    // A node left with one leaf and an empty side is just that leaf; one left with an internal
+    // child still holds two or more accounts and stays
+    uint32_t replacement = none;
+    for (size_t depth = path.size(); depth-- > 0;) {
+        Node& node = nodes[path[depth]];
+        node.children[keyBit(key, depth)] = replacement;
+        const uint32_t left = node.children[0];
+        const uint32_t right = node.children[1];
+        if (left != none && right != none) return;
+        const uint32_t only = left != none ? left : right;
+        if (only != none && !nodes[only].leaf) return;
+        freeNodes.push_back(path[depth]);
+        replacement = only;
+    }
+    rootNode = replacement;
+}
+
+// Dirty nodes are collected by depth and each depth is hashed in one multi-buffer call, children
+// before parents
+void StateTree::rehash() {
+    vector<vector<uint32_t>> byDepth;
+    vector<pair<uint32_t, size_t>> stack;
+    if (rootNode != none && nodes[rootNode].dirty) stack.push_back({rootNode, 0});
+    while (!stack.empty()) {
+        const auto [index, depth] = stack.back();
+        stack.pop_back();
+        if (byDepth.size() <= depth) byDepth.resize(depth + 1);
+        byDepth[depth].push_back(index);
+        if (nodes[index].leaf) continue;
+        for (uint32_t child : nodes[index].children) {
+            if (child != none && nodes[child].dirty) stack.push_back({child, depth + 1});
+        }
+    }
+
+    vector<uint8_t> messages;
+    vector<const void*> inputs;
+    vector<size_t> lengths;
+    vector<Hash256> digests;
+    const Hash256 empty;
+    for (size_t depth = byDepth.size(); depth-- > 0;) {
+        const vector<uint32_t>& level = byDepth[depth];
+        const size_t count = level.size();
+        messages.resize(count * nodeMessageSize);
+        inputs.resize(count);
+        lengths.resize(count);
+        digests.resize(count);
+        size_t total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const Node& node = nodes[level[i]];
+            uint8_t* message = &messages[i * nodeMessageSize];
+            if (node.leaf) {
+                encodeLeaf(message, keys[level[i]], balances[level[i]]);
+                lengths[i] = leafMessageSize;
+            } else {
+                const uint32_t left = node.children[0];
+                const uint32_t right = node.children[1];
+                encodeNode(message, left == none ? empty : hashes[left], right == none ? empty : hashes[right]);
+                lengths[i] = nodeMessageSize;
+            }
+            inputs[i] = message;
+            total += lengths[i];
+        }
+        calc_sha_256_many(digests[0].data(), inputs.data(), lengths.data(), count);
+        METRIC_ADD(sha256Calls, count);
+        METRIC_ADD(sha256Bytes, total);
+        for (size_t i = 0; i < count; ++i) {
+            hashes[level[i]] = digests[i];
+            nodes[level[i]].dirty = false;
+        }
+    }
+    root = rootNode == none ? Hash256() : hashes[rootNode];
+}
+
+StateProof StateTree::prove(const Hash256& key) const {
+    StateProof proof;
+    uint32_t current = rootNode;
+    while (current != none && !nodes[current].leaf) {
+        const int bit = keyBit(key, proof.siblings.size());
+        const uint32_t sibling = nodes[current].children[1 - bit];
+        proof.siblings.push_back(sibling == none ? Hash256() : hashes[sibling]);
+        current = nodes[current].children[bit];
+    }
+    if (current != none) {
+        proof.endsAtLeaf = true;
+        proof.leafKey = keys[current];
+        proof.leafBalance = balances[current];
+    }
+    return proof;
+}
+
+// Rebuild the root from the end of the path upwards. A leaf for another key proves absence only
+// if it sits on key's path, i.e. shares key's first bits down to where the path ends.
+bool StateTree::verify(const Hash256& root, const Hash256& key, const StateProof& proof, bool& present,
+                       int64_t& balance) {
+    const size_t depth = proof.siblings.size();
+    if (depth > 8 * key.size()) return false;
+    Hash256 hash;
+    if (proof.endsAtLeaf) {
+        for (size_t d = 0; d < depth; ++d) {
+            if (keyBit(proof.leafKey, d) != keyBit(key, d)) return false;
+        }
+        uint8_t message[leafMessageSize];
+        encodeLeaf(message, proof.leafKey, proof.leafBalance);
+        hash = digest(message, sizeof(message));
+    }
+    for (size_t d = depth; d-- > 0;) {
+        uint8_t message[nodeMessageSize];
+        if (keyBit(key, d)) {
+            encodeNode(message, proof.siblings[d], hash);
+        } else {
+            encodeNode(message, hash, proof.siblings[d]);
+        }
+        hash = digest(message, sizeof(message));
+    }
+    if (hash != root) return false;
+    present = proof.endsAtLeaf && proof.leafKey == key;
+    balance = present ? proof.leafBalance : 0;
+    return true;
+}
+
+PendingBalances::PendingBalances(const StateTree& base, bool checkFunds) : base(base), checkFunds(checkFunds) {}
+
+int64_t& PendingBalances::balance(uint32_t accountId) {
+    auto found = balances.find(accountId);
+    if (found == balances.end()) {
+        const int64_t current = base.balanceOf(accountId);
+        found = balances.emplace(accountId, Entry{current, current}).first;
+    }
+    return found->second.after;
+}
+
+// Minted funds have no sender balance to debit, and burned funds no receiver balance to credit
+bool PendingBalances::tryApply(const Transaction& transaction) {
+    const int64_t amount = transaction.amount;
+    if (checkFunds && amount < 0) return false;
+    const bool minted = transaction.senderId == base.issuerId;
+    const bool burned = transaction.receiverId == base.issuerId;
+
+    int64_t senderAfter = 0;
+    if (!minted) {
+        const int64_t senderBalance = balance(transaction.senderId);
+        if (checkFunds && senderBalance < amount) return false;
+        if (!subtractChecked(senderBalance, amount, senderAfter)) return false;
+    }
+    if (transaction.senderId == transaction.receiverId) return true; // Funds checked; nothing moves
+    int64_t receiverAfter = 0;
+    if (!burned && !addChecked(balance(transaction.receiverId), amount, receiverAfter)) return false;
+
+    if (!minted) balance(transaction.senderId) = senderAfter;
+    if (!burned) balance(transaction.receiverId) = receiverAfter;
+    return true;
+}
+
+void PendingBalances::clear() {
+    balances.clear();
+}
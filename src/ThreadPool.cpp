@@ -0,0 +1,107 @@
+// src/ThreadPool.cpp
+
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+using namespace std;
+
+// Start the worker threads
+ThreadPool::ThreadPool(size_t threadCount) {
+    for (size_t i = 0; i < threadCount; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+// Drain the queue and join every worker
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+// The calling thread always takes part in parallelFor, so one worker per extra core is enough
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(max(1u, thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+size_t ThreadPool::size() const {
+    return workers.size();
+}
+
+void ThreadPool::submit(function<void()> task) {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(move(task));
+    }
+    wake.notify_one();
+}
+
+// Run tasks until the pool is stopped and the queue is empty
+void ThreadPool::workerLoop() {
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) return;
+            task = move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+// Chunks are handed out through a shared counter, so fast threads simply claim more of them.
+// The caller claims chunks too and only waits for chunks that are already running, which keeps
+// nested calls from a worker free of deadlock even when every worker is busy.
+void ThreadPool::parallelFor(size_t count, size_t grain, const function<void(size_t, size_t)>& fn) {
+    if (count == 0) return;
+    grain = max<size_t>(grain, 1);
+    const size_t chunks = (count + grain - 1) / grain;
+    if (chunks == 1 || workers.empty()) {
+        fn(0, count);
+        return;
+    }
+
+    struct State {
+        atomic<size_t> next{0}; // Next chunk to claim
+        size_t finished = 0; // Chunks completed, guarded by mutex
+        std::mutex mutex;
+        condition_variable done;
+    };
+    auto state = make_shared<State>();
+    const function<void(size_t, size_t)>* body = &fn;
+
+    // Helpers hold the state alive on their own; they touch fn only while a chunk is unclaimed,
+    // which is before this call can return.
+    auto runChunks = [state, body, count, grain, chunks]() {
+        size_t completed = 0;
+        for (size_t chunk = state->next++; chunk < chunks; chunk = state->next++) {
+            const size_t begin = chunk * grain;
+            (*body)(begin, min(count, begin + grain));
+            ++completed;
+        }
+        if (completed > 0) {
+            lock_guard<std::mutex> lock(state->mutex);
+            state->finished += completed;
+            if (state->finished == chunks) state->done.notify_all();
+        }
+    };
+
+    const size_t helpers = min(workers.size(), chunks - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        submit(runChunks);
+    }
+    runChunks();
+
+    unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&] { return state->finished == chunks; });
+}
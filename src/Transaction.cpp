@@ -1,31 +1,125 @@
 // src/Transaction.cpp
 
 #include "Transaction.h"
+#include "AccountRegistry.h"
+#include <cstring>
 #include <ctime>
-#include <iomanip>
-#include <sstream>
+#include <type_traits>
 
 using namespace std;
 
+static_assert(is_trivially_copyable<Transaction>::value, "Transaction must stay a plain value");
+
 // Constructor implementation
-Transaction::Transaction(const std::string& sender, const std::string& receiver, float amount) 
-    : sender(sender), receiver(receiver), amount(amount) {
-    // Set timestamp to the current time in ISO 8601 format
-    time_t now = time(nullptr);
-    stringstream ss;
-    ss << put_time(localtime(&now), "%Y-%m-%d %H:%M:%S");
-    timestamp = ss.str();
+Transaction::Transaction(string_view sender, string_view receiver, int64_t amount)
+    : Transaction(sender, receiver, amount, static_cast<int64_t>(time(nullptr))) {}
+
+Transaction::Transaction(string_view sender, string_view receiver, int64_t amount, int64_t timestamp)
+    : senderId(AccountRegistry::global().intern(sender)),
+      receiverId(AccountRegistry::global().intern(receiver)),
+      amount(amount),
+      timestamp(timestamp) {}
+
+Transaction::Transaction(uint32_t senderId, uint32_t receiverId, int64_t amount, int64_t timestamp)
+    : senderId(senderId), receiverId(receiverId), amount(amount), timestamp(timestamp) {}
+
+string_view Transaction::sender() const {
+    return AccountRegistry::global().name(senderId);
+}
+
+string_view Transaction::receiver() const {
+    return AccountRegistry::global().name(receiverId);
+}
+
+size_t Transaction::encodedSize() const {
+    return 4 + sender().size() + 4 + receiver().size() + 8 + 8;
+}
+
+uint8_t* Transaction::encode(uint8_t* out) const {
+    writeCanonical([&out](const void* data, size_t len) {
+        memcpy(out, data, len);
+        out += len;
+    });
+    return out;
+}
+
+// Read a length-prefixed name in place, advancing pos; false if it runs past end
+static bool getName(const uint8_t*& pos, const uint8_t* end, string_view& name) {
+    if (end - pos < 4) return false;
+    const uint32_t length = getUint32LE(pos);
+    pos += 4;
+    if (static_cast<size_t>(end - pos) < length) return false;
+    name = string_view(reinterpret_cast<const char*>(pos), length);
+    pos += length;
+    return true;
 }
 
-// Serialize function implementation
-std::string Transaction::serialize() const {
-    return sender + receiver + to_string(amount) + timestamp;
+optional<Transaction> Transaction::decode(const uint8_t* data, size_t size) {
+    const uint8_t* pos = data;
+    const uint8_t* end = data + size;
+    string_view sender, receiver;
+    if (!getName(pos, end, sender) || !getName(pos, end, receiver) || end - pos != 16) return nullopt;
+    return Transaction(sender, receiver, static_cast<int64_t>(getUint64LE(pos)),
+                       static_cast<int64_t>(getUint64LE(pos + 8)));
 }
 
 // Equality operator implementation
 bool Transaction::operator==(const Transaction& other) const {
-    return sender == other.sender &&
-           receiver == other.receiver &&
+    return senderId == other.senderId &&
+           receiverId == other.receiverId &&
            amount == other.amount &&
            timestamp == other.timestamp;
 }
+
+// Accepts an optional '-', digits, and at most 8 digits after an optional '.'
+bool Transaction::parseAmount(string_view text, int64_t& units) {
+    bool negative = false;
+    if (!text.empty() && text[0] == '-') {
+        negative = true;
+        text.remove_prefix(1);
+    }
+
+    int64_t whole = 0;
+    int64_t fraction = 0;
+    int fractionDigits = 0;
+    bool seenDigit = false;
+    bool seenPoint = false;
+    for (char c : text) {
+        if (c == '.' && !seenPoint) {
+            seenPoint = true;
+        } else if (c >= '0' && c <= '9') {
+            seenDigit = true;
+            if (seenPoint) {
+                if (++fractionDigits > 8) return false; // Finer than one unit
+                fraction = fraction * 10 + (c - '0');
+            } else {
+                if (whole > (INT64_MAX / amountScale - (c - '0')) / 10) return false; // Would overflow
+                whole = whole * 10 + (c - '0');
+            }
+        } else {
+            return false;
+        }
+    }
+    if (!seenDigit) return false;
+
+    for (int i = fractionDigits; i < 8; ++i) fraction *= 10;
+    if (whole == INT64_MAX / amountScale && fraction > INT64_MAX % amountScale) return false;
+    units = whole * amountScale + fraction;
+    if (negative) units = -units;
+    return true;
+}
+
+string Transaction::formatAmount(int64_t units) {
+    const bool negative = units < 0;
+    const uint64_t magnitude = negative ? 0 - static_cast<uint64_t>(units) : static_cast<uint64_t>(units);
+    string text = to_string(magnitude / amountScale);
+    uint64_t fraction = magnitude % amountScale;
+    if (fraction != 0) {
+        string digits = to_string(fraction);
+        digits.insert(0, 8 - digits.size(), '0');
+        digits.erase(digits.find_last_not_of('0') + 1);
+        text += '.';
+        text += digits;
+    }
+    return negative ? "-" + text : text;
+}
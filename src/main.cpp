@@ -1,10 +1,31 @@
 
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
 #include "Blockchain.h"
+#include "Ingest.h"
+#include "Mempool.h"
+#include "Metrics.h"
 #include "Transaction.h"
 
 using namespace std;
 
+// Directory holding the binary block store
+static const string dataPath = "blockchain_data";
+// Most transactions taken from the pool into one block
+static const size_t maxBlockTransactions = 10000;
+// Chain whose block is being mined and the number of its search, for the Ctrl+C handler
+static Blockchain* miningChain = nullptr;
+static uint64_t miningSearch = 0;
+
+// Ctrl+C during mining cancels that block's search instead of ending the program
+void cancelMiningOnInterrupt(int) {
+    if (miningChain) miningChain->cancelMining(miningSearch);
+}
+
 void displayMenu() {
     cout << "\nBlockchain Menu Options:\n";
     cout << "1. Add a transaction\n";
@@ -15,6 +36,11 @@ void displayMenu() {
     cout << "6. Validate blockchain\n";
     cout << "7. Save blockchain to file\n";
     cout << "8. Load blockchain from file\n";
+    cout << "9. Set mining difficulty\n";
+    cout << "10. Show metrics\n";
+    cout << "11. Show account balance\n";
+    cout << "12. View an account's transactions\n";
+    cout << "13. View blocks between two timestamps\n";
     cout << "0. Exit\n";
     cout << "Choose an option: ";
 }
@@ -25,9 +51,10 @@ void displayTransactions(const vector<Transaction>& transactions) {
     } else {
         for (size_t i = 0; i < transactions.size(); ++i) {
             cout << "Transaction #" << (i + 1) << ": "
-                 << transactions[i].sender << " -> " 
-                 << transactions[i].receiver << ", Amount: " 
-                 << transactions[i].amount << endl;
+                 << transactions[i].sender() << " -> " 
+                 << transactions[i].receiver() << ", Amount: " 
+                 << Transaction::formatAmount(transactions[i].amount)
+                 << " (ID: " << MerkleTree::leafHash(transactions[i]).toHex() << ")" << endl;
         }
     }
 }
@@ -35,22 +62,133 @@ void displayTransactions(const vector<Transaction>& transactions) {
 void displayBlockchain(const Blockchain& blockchain) {
     for (const auto& block : blockchain.chain) {
         cout << "Block #" << block.index << endl;
-        cout << "Hash: " << block.hash() << endl;
-        cout << "Previous Hash: " << block.previousHash << endl;
-        cout << "Merkle Root: " << block.merkleRoot << endl;
+        cout << "Hash: " << block.hash().toHex() << endl;
+        cout << "Previous Hash: " << block.previousHash.toHex() << endl;
+        cout << "Merkle Root: " << block.merkleRoot.toHex() << endl;
         cout << "Timestamp: " << block.timestamp << endl;
-        displayTransactions(block.transactions);
+        cout << "Difficulty: " << block.difficulty << ", Nonce: " << block.nonce << endl;
+        BlockCache::Body transactions = blockchain.getTransactions(block.index);
+        if (transactions) {
+            displayTransactions(*transactions);
+        } else {
+            cout << "Could not read the block's transactions.\n";
+        }
         cout << endl;
     }
 }
 
-int main() {
+// Add a transaction to the running Merkle root of the pool, keeping its id for the block
+void appendPending(const Transaction& transaction, MerkleAccumulator& pendingRoot, vector<Hash256>& pendingIds) {
+    pendingIds.push_back(MerkleTree::leafHash(transaction));
+    pendingRoot.appendLeaf(pendingIds.back());
+}
+
+// Point the running Merkle root at the pool's current contents, oldest first
+void rebuildPendingRoot(const Mempool& pool, MerkleAccumulator& pendingRoot, vector<Hash256>& pendingIds) {
+    pendingRoot.clear();
+    pendingIds.clear();
+    for (const Transaction& transaction : pool.snapshot()) {
+        appendPending(transaction, pendingRoot, pendingIds);
+    }
+}
+
+// Open the chain in path for appending, creating the store if it does not exist yet
+bool openOrCreateStore(Blockchain& blockchain, const string& path) {
+    return blockchain.openStore(path) || (blockchain.saveToFile(path) && blockchain.openStore(path));
+}
+
+// Headless bulk load: blockchainApp ingest [options] [FILE]
+int runIngest(int argc, char* argv[]) {
+    IngestOptions options;
+    string storePath = dataPath;
+    string inputPath = "-";
+    uint32_t difficulty = 0;
+    uint32_t minimumDifficulty = 0;
+    for (int i = 2; i < argc; ++i) {
+        const string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--format" && hasValue) {
+            const string format = argv[++i];
+            if (format != "csv" && format != "binary") {
+                cerr << "Unknown format " << format << "; use csv or binary.\n";
+                return 2;
+            }
+            options.format = format == "csv" ? IngestFormat::Csv : IngestFormat::Binary;
+        } else if (arg == "--block-size" && hasValue) {
+            options.blockSize = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--block-interval-ms" && hasValue) {
+            options.blockIntervalMs = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--save-every" && hasValue) {
+            options.saveEveryBlocks = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--difficulty" && hasValue) {
+            difficulty = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--min-difficulty" && hasValue) {
+            minimumDifficulty = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--check-balances") {
+            options.checkBalances = true;
+        } else if (arg == "--store" && hasValue) {
+            storePath = argv[++i];
+        } else if (arg[0] != '-' || arg == "-") {
+            inputPath = arg;
+        } else {
+            cerr << "Usage: " << argv[0] << " ingest [--format csv|binary] [--block-size N] [--block-interval-ms T]\n"
+                 << "       [--save-every BLOCKS] [--difficulty BITS] [--min-difficulty BITS]\n"
+                 << "       [--check-balances] [--store DIR] [FILE | -]\n";
+            return 2;
+        }
+    }
+
+    const int inputFd = inputPath == "-" ? STDIN_FILENO : ::open(inputPath.c_str(), O_RDONLY);
+    if (inputFd < 0) {
+        cerr << "Cannot open " << inputPath << ".\n";
+        return 1;
+    }
+
+    Blockchain blockchain;
+    blockchain.setMinimumDifficulty(minimumDifficulty); // Before opening, so log replay enforces it
+    if (!openOrCreateStore(blockchain, storePath)) {
+        cerr << "Cannot open the block store in " << storePath << ".\n";
+        if (inputFd != STDIN_FILENO) ::close(inputFd);
+        return 1;
+    }
+    blockchain.setDifficulty(difficulty);
+
+    IngestStats stats;
+    const bool ok = ingest(blockchain, inputFd, options, stats);
+    if (inputFd != STDIN_FILENO) ::close(inputFd);
+    cout << "Ingested " << stats.transactions << " transactions into " << stats.blocks << " blocks in "
+         << stats.seconds << " s (" << (stats.seconds > 0 ? stats.transactions / stats.seconds : 0) << " tx/s, "
+         << (stats.seconds > 0 ? stats.bytesRead / stats.seconds / 1e6 : 0) << " MB/s of input).\n";
+    if (stats.rejected > 0) cout << stats.rejected << " malformed records were skipped.\n";
+    if (stats.unfunded > 0) cout << stats.unfunded << " transfers exceeding the sender's balance were skipped.\n";
+    cout << "The chain now has " << blockchain.chain.size() << " blocks in " << storePath << ".\n";
+    if (!ok) {
+        cerr << "Ingest stopped early: the input could not be read or the chain could not be saved.\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "ingest") == 0) {
+        return runIngest(argc, argv);
+    }
+
     Blockchain blockchain;
-    vector<Transaction> transactionPool;
+    Mempool transactionPool;
+    MerkleAccumulator pendingRoot; // Running Merkle root of the pool, updated on every add
+    vector<Hash256> pendingIds; // Ids of the pool's transactions, in the same order
     int choice;
 
 
-    blockchain.loadFromFile("blockchain_data.txt");
+    // New blocks are logged to the store as they are added, so the store is created up front
+    if (blockchain.openStore(dataPath)) {
+        cout << "Loaded " << blockchain.chain.size() << " blocks from " << dataPath << ".\n";
+    } else if (openOrCreateStore(blockchain, dataPath)) {
+        cout << "No saved blockchain found. Starting with a new blockchain in " << dataPath << ".\n";
+    } else {
+        cerr << "Could not open " << dataPath << "; new blocks are kept in memory only.\n";
+    }
 
     while (true) {
         displayMenu();
@@ -64,19 +202,27 @@ int main() {
 
         switch (choice) {
             case 1: { // Add a transaction
-                string sender, receiver;
-                double amount;
+                string sender, receiver, amountText;
+                int64_t amount;
 
                 cout << "Enter sender name: ";
                 cin >> sender;
                 cout << "Enter receiver name: ";
                 cin >> receiver;
                 cout << "Enter amount: ";
-                cin >> amount;
+                cin >> amountText;
+                if (!Transaction::parseAmount(amountText, amount)) {
+                    cout << "Enter the amount as a decimal number with at most 8 decimal places.\n";
+                    break;
+                }
 
                 Transaction newTransaction(sender, receiver, amount);
-                transactionPool.push_back(newTransaction);
-                cout << "Transaction added to the pool.\n";
+                if (transactionPool.add(newTransaction)) {
+                    appendPending(newTransaction, pendingRoot, pendingIds);
+                    cout << "Transaction added to the pool.\n";
+                } else {
+                    cout << "An identical transaction is already in the pool.\n";
+                }
                 break;
             }
 
@@ -84,16 +230,44 @@ int main() {
                 if (transactionPool.empty()) {
                     cout << "No transactions to add to a new block.\n";
                 } else {
-                    blockchain.addBlock(transactionPool);
-                    transactionPool.clear();
-                    cout << "New block added to the blockchain.\n";
+                    vector<Transaction> batch = transactionPool.drainBatch(maxBlockTransactions);
+                    const bool mining = blockchain.getDifficulty() > 0;
+                    if (mining) {
+                        cout << "Mining... press Ctrl+C to cancel.\n";
+                        miningChain = &blockchain;
+                        miningSearch = blockchain.nextMiningSearch(); // Set before the handler can run
+                        signal(SIGINT, cancelMiningOnInterrupt);
+                    }
+                    // When the whole pool fits in the block, seal it with the running root
+                    const bool added = batch.size() == pendingRoot.leafCount()
+                                           ? blockchain.addBlock(move(batch), pendingRoot, pendingIds.data())
+                                           : blockchain.addBlock(move(batch));
+                    if (mining) {
+                        signal(SIGINT, SIG_DFL);
+                        miningChain = nullptr;
+                    }
+                    if (added) {
+                        cout << "New block added to the blockchain.\n";
+                        if (!blockchain.syncLog()) cerr << "Failed to write the block to the log.\n";
+                        if (blockchain.getDifficulty() > 0) {
+                            const MiningResult& mined = blockchain.getLastMiningResult();
+                            cout << "Mined with nonce " << mined.nonce << " after " << mined.attempts
+                                 << " attempts (" << mined.hashesPerSecond << " hashes/s).\n";
+                        }
+                    } else {
+                        for (Transaction& transaction : batch) transactionPool.add(move(transaction));
+                        cout << "The block was not added (mining was cancelled or a transfer was rejected); "
+                                "the transactions stay in the pool.\n";
+                    }
+                    rebuildPendingRoot(transactionPool, pendingRoot, pendingIds);
                 }
                 break;
             }
 
             case 3: { // View all transactions in the pool
                 cout << "Transactions in the pool:\n";
-                displayTransactions(transactionPool);
+                displayTransactions(transactionPool.snapshot());
+                cout << "Pending Merkle root: " << pendingRoot.getRootHash().toHex() << "\n";
                 break;
             }
 
@@ -107,32 +281,27 @@ int main() {
                 if (blockchain.chain.empty()) {
                     cout << "Blockchain is empty.\n";
                 } else {
-                    string sender, receiver;
-                    double amount;
+                    string txIdHex;
+                    Hash256 txHash;
                     bool found = false;
 
-                    cout << "Enter sender name: ";
-                    cin >> sender;
-                    cout << "Enter receiver name: ";
-                    cin >> receiver;
-                    cout << "Enter amount: ";
-                    cin >> amount;
-
-                    Transaction transaction(sender, receiver, amount);
-
-                    // Check each block for the transaction
-                    for (const auto& block : blockchain.chain) {
-                        for (const auto& tx : block.transactions) {
-                            if (tx == transaction) {
-                                found = true;
-                                break;
-                            }
-                        }
-                        if (found) break;
+                    cout << "Enter transaction ID: ";
+                    cin >> txIdHex;
+                    if (!Hash256::fromHex(txIdHex, txHash)) {
+                        cout << "A transaction ID is 64 hexadecimal characters.\n";
+                        break;
+                    }
+
+                    // Locate the transaction and check its proof against the block's Merkle root
+                    size_t blockIndex = 0;
+                    MerkleProof proof;
+                    if (blockchain.getTransactionProof(txHash, blockIndex, proof)) {
+                        found = MerkleTree::verifyProof(txHash, proof, blockchain.chain[blockIndex].merkleRoot);
                     }
 
                     if (found) {
-                        cout << "Transaction is part of the blockchain.\n";
+                        cout << "Transaction is part of block #" << blockIndex << " (verified with "
+                             << proof.size() << " Merkle proof steps).\n";
                     } else {
                         cout << "Transaction not found in the blockchain.\n";
                     }
@@ -141,21 +310,107 @@ int main() {
             }
 
             case 6: { // Validate blockchain
-                if (blockchain.validateChain()) {
+                size_t failedIndex = 0;
+                if (blockchain.validateChain(failedIndex)) {
                     cout << "Blockchain is valid.\n";
                 } else {
-                    cout << "Blockchain is invalid!\n";
+                    cout << "Blockchain is invalid! First bad block: #" << failedIndex << "\n";
                 }
                 break;
             }
 
             case 7: { // Save blockchain to file
-                blockchain.saveToFile("blockchain_data.txt");
+                if (blockchain.compactLog() || blockchain.saveToFile(dataPath)) {
+                    cout << "Blockchain saved to " << dataPath << "\n";
+                } else {
+                    cerr << "Failed to save blockchain to " << dataPath << ".\n";
+                }
                 break;
             }
 
             case 8: { // Load blockchain from file
-                blockchain.loadFromFile("blockchain_data.txt");
+                if (blockchain.openStore(dataPath)) {
+                    cout << "Loaded " << blockchain.chain.size() << " blocks from " << dataPath << ".\n";
+                } else {
+                    cout << "No saved blockchain found. Starting with a new blockchain.\n";
+                }
+                break;
+            }
+
+            case 9: { // Set mining difficulty
+                uint32_t bits;
+                cout << "Enter difficulty (leading zero bits, 0 disables mining): ";
+                cin >> bits;
+                blockchain.setDifficulty(bits);
+                cout << "Difficulty set to " << blockchain.getDifficulty() << ".\n";
+                break;
+            }
+
+            case 10: { // Show metrics
+                if (!METRICS_ENABLED) {
+                    cout << "Metrics were compiled out of this build.\n";
+                } else {
+                    cout << Metrics::global().toPrometheus();
+                }
+                break;
+            }
+
+            case 11: { // Show account balance
+                string account;
+                cout << "Enter account name: ";
+                cin >> account;
+
+                // Check the balance's proof against the state root committed in the last block
+                int64_t balance = 0;
+                StateProof proof;
+                bool present = false;
+                if (blockchain.chain.empty()) {
+                    cout << "Blockchain is empty.\n";
+                } else if (!blockchain.getBalance(account, balance, &proof) ||
+                           !StateTree::verify(blockchain.chain.back().stateRoot, StateTree::accountKey(account), proof,
+                                              present, balance)) {
+                    cout << "The balances do not match the chain's state root; validate the blockchain.\n";
+                } else {
+                    cout << account << ": " << Transaction::formatAmount(balance) << " (verified with "
+                         << proof.siblings.size() << " state proof steps" << (present ? "" : "; the account holds nothing")
+                         << ").\n";
+                }
+                break;
+            }
+
+            case 12: { // View an account's transactions
+                string account;
+                cout << "Enter account name: ";
+                cin >> account;
+
+                size_t count = 0;
+                const bool read = blockchain.forEachAccountTransaction(
+                    account, AccountRole::Either, [&](const TransactionLocation& location, const Transaction& tx) {
+                        cout << "Block #" << location.blockIndex << ", transaction #" << (location.position + 1) << ": "
+                             << tx.sender() << " -> " << tx.receiver() << ", Amount: "
+                             << Transaction::formatAmount(tx.amount) << "\n";
+                        ++count;
+                        return true;
+                    });
+                if (!read) cout << "Could not read every block's transactions.\n";
+                cout << count << " transactions found for " << account << ".\n";
+                break;
+            }
+
+            case 13: { // View blocks between two timestamps
+                int64_t from;
+                int64_t to;
+                cout << "Enter the first and last timestamp (seconds since the Unix epoch): ";
+                cin >> from >> to;
+
+                size_t count = 0;
+                blockchain.forEachBlockBetween(from, to, [&](size_t height) {
+                    const Block& block = blockchain.chain[height];
+                    cout << "Block #" << height << " at " << block.timestamp << ": " << block.hash().toHex() << "\n";
+                    ++count;
+                    return true;
+                });
+                cout << count << " blocks found.\n";
                 break;
             }
 
@@ -2,6 +2,16 @@
 
 #define TOTAL_LEN_LEN 8
 
+/*
+ * The SHA-NI path needs GCC/Clang target attributes and CPUID helpers, so it is only built for x86 with those
+ * compilers. Everything else uses the portable compression function alone.
+ */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SHA_256_HW 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 /*
  * Comments from pseudo-code at https://en.wikipedia.org/wiki/SHA-2 are reproduced here.
  * When useful for clarification, portions of the pseudo-code are reproduced here too.
@@ -21,14 +31,28 @@ static inline uint32_t right_rot(uint32_t value, unsigned int count)
 	return value >> count | value << (32 - count);
 }
 
+/*
+ * Initialize array of round constants:
+ * (first 32 bits of the fractional parts of the cube roots of the first 64 primes 2..311):
+ */
+static const uint32_t k[] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
 /*
  * @brief Update a hash value under calculation with a new chunk of data.
  * @param h Pointer to the first hash item, of a total of eight.
  * @param p Pointer to the chunk data, which has a standard length.
  *
- * @note This is the SHA-256 work horse.
+ * @note This is the SHA-256 work horse, in portable C. It is used whenever the CPU lacks the SHA extensions.
  */
-static inline void consume_chunk(uint32_t *h, const uint8_t *p)
+static void consume_chunk_portable(uint32_t *h, const uint8_t *p)
 {
 	unsigned i, j;
 	uint32_t ah[8];
@@ -71,22 +95,6 @@ static inline void consume_chunk(uint32_t *h, const uint8_t *p)
 			const uint32_t s1 = right_rot(ah[4], 6) ^ right_rot(ah[4], 11) ^ right_rot(ah[4], 25);
 			const uint32_t ch = (ah[4] & ah[5]) ^ (~ah[4] & ah[6]);
 
-			/*
-			 * Initialize array of round constants:
-			 * (first 32 bits of the fractional parts of the cube roots of the first 64 primes 2..311):
-			 */
-			static const uint32_t k[] = {
-			    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4,
-			    0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe,
-			    0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
-			    0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
-			    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
-			    0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
-			    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116,
-			    0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
-			    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7,
-			    0xc67178f2};
-
 			const uint32_t temp1 = ah[7] + s1 + ch + k[i << 4 | j] + w[j];
 			const uint32_t s0 = right_rot(ah[0], 2) ^ right_rot(ah[0], 13) ^ right_rot(ah[0], 22);
 			const uint32_t maj = (ah[0] & ah[1]) ^ (ah[0] & ah[2]) ^ (ah[1] & ah[2]);
@@ -108,6 +116,88 @@ static inline void consume_chunk(uint32_t *h, const uint8_t *p)
 		h[i] += ah[i];
 }
 
+#ifdef SHA_256_HW
+/*
+ * @brief Same as consume_chunk_portable, using the Intel SHA extensions (SHA-NI).
+ * @param h Pointer to the first hash item, of a total of eight.
+ * @param p Pointer to the chunk data, which has a standard length.
+ *
+ * @note The SHA instructions keep the state as the ABEF and CDGH halves, so the state is shuffled in and out of that
+ * layout around the 64 rounds. Each group of four rounds adds four round constants to four message words, runs two
+ * sha256rnds2 steps, and extends the message schedule with sha256msg1/sha256msg2.
+ */
+__attribute__((target("sha,sse4.1"))) static void consume_chunk_hw(uint32_t *h, const uint8_t *p)
+{
+	const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i msg[4];
+	unsigned i;
+
+	/* Load the state and rearrange it from ABCD/EFGH to ABEF/CDGH. */
+	__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[0]), 0xB1);
+	__m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[4]), 0x1B);
+	__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+	const __m128i abef_save = state0;
+	const __m128i cdgh_save = state1;
+
+	for (i = 0; i < 4; i++)
+		msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 16 * i)), byte_swap);
+
+	for (i = 0; i < 16; i++) {
+		const __m128i cur = msg[i & 3];
+		__m128i m = _mm_add_epi32(cur, _mm_loadu_si128((const __m128i *)&k[4 * i]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		if (i >= 3 && i <= 14) {
+			/* Finish w[4(i+1)..4(i+1)+3] for the next group. */
+			const __m128i next = _mm_add_epi32(msg[(i + 1) & 3], _mm_alignr_epi8(cur, msg[(i + 3) & 3], 4));
+			msg[(i + 1) & 3] = _mm_sha256msg2_epu32(next, cur);
+		}
+		m = _mm_shuffle_epi32(m, 0x0E);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, m);
+		if (i >= 1 && i <= 12)
+			msg[(i + 3) & 3] = _mm_sha256msg1_epu32(msg[(i + 3) & 3], cur);
+	}
+
+	/* Add the compressed chunk to the current hash value and restore the ABCD/EFGH layout. */
+	state0 = _mm_add_epi32(state0, abef_save);
+	state1 = _mm_add_epi32(state1, cdgh_save);
+	tmp = _mm_shuffle_epi32(state0, 0x1B);
+	state1 = _mm_shuffle_epi32(state1, 0xB1);
+	_mm_storeu_si128((__m128i *)&h[0], _mm_blend_epi16(tmp, state1, 0xF0));
+	_mm_storeu_si128((__m128i *)&h[4], _mm_alignr_epi8(state1, tmp, 8));
+}
+
+/*
+ * @brief Check CPUID for the SHA extensions and the SSSE3/SSE4.1 instructions the hardware path also uses.
+ */
+static int detect_hw(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	const int ssse3 = (ecx >> 9) & 1;
+	const int sse41 = (ecx >> 19) & 1;
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+		return 0;
+	const int sha = (ebx >> 29) & 1;
+	return ssse3 && sse41 && sha;
+}
+#endif
+
+/*
+ * The compression function in use. It starts out portable and is switched to the hardware path at load time when
+ * the CPU supports it.
+ */
+static void (*consume_chunk)(uint32_t *h, const uint8_t *p) = consume_chunk_portable;
+
+#ifdef SHA_256_HW
+__attribute__((constructor)) static void select_consume_chunk(void)
+{
+	if (detect_hw())
+		consume_chunk = consume_chunk_hw;
+}
+#endif
+
 /*
  * Public functions. See header file for documentation.
  */
@@ -224,3 +314,108 @@ void calc_sha_256(uint8_t hash[SIZE_OF_SHA_256_HASH], const void *input, size_t
 	sha_256_write(&sha_256, input, len);
 	(void)sha_256_close(&sha_256);
 }
+
+void sha_256_clone(struct Sha_256 *dst, const struct Sha_256 *src, uint8_t hash[SIZE_OF_SHA_256_HASH])
+{
+	*dst = *src;
+	dst->hash = hash;
+	dst->chunk_pos = dst->chunk + (src->chunk_pos - src->chunk);
+}
+
+int sha_256_hw_available(void)
+{
+#ifdef SHA_256_HW
+	return detect_hw();
+#else
+	return 0;
+#endif
+}
+
+int sha_256_use_hw(int enable)
+{
+#ifdef SHA_256_HW
+	if (enable && detect_hw()) {
+		consume_chunk = consume_chunk_hw;
+		return 1;
+	}
+#endif
+	(void)enable;
+	consume_chunk = consume_chunk_portable;
+	return 0;
+}
+
+/*
+ * @brief Tiny xorshift generator for the self-test, so that it needs nothing from the C library.
+ */
+static uint32_t self_test_rand(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+int sha_256_self_test(void)
+{
+	/* FIPS 180-2 / NIST example vectors. */
+	static const char *const messages[] = {"", "abc", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"};
+	static const uint8_t expected[][SIZE_OF_SHA_256_HASH] = {
+	    {0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14, 0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
+	     0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b, 0x93, 0x4c, 0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55},
+	    {0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+	     0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad},
+	    {0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+	     0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1}};
+	/* SHA-256 of one million 'a' characters, fed through the streaming API. */
+	static const uint8_t million_a[SIZE_OF_SHA_256_HASH] = {
+	    0xcd, 0xc7, 0x6e, 0x5c, 0x99, 0x14, 0xfb, 0x92, 0x81, 0xa1, 0xc7, 0xe2, 0x84, 0xd7, 0x3e, 0x67,
+	    0xf1, 0x80, 0x9a, 0x48, 0xa4, 0x97, 0x20, 0x0e, 0x04, 0x6d, 0x39, 0xcc, 0xc7, 0x11, 0x2c, 0xd0};
+
+	void (*const saved)(uint32_t *, const uint8_t *) = consume_chunk;
+	const int paths = sha_256_hw_available() ? 2 : 1;
+	uint8_t hash[SIZE_OF_SHA_256_HASH];
+	uint8_t other[SIZE_OF_SHA_256_HASH];
+	int failures = 0;
+	int path;
+	size_t i;
+
+	/* Known answers, once per available compression function. */
+	for (path = 0; path < paths; path++) {
+		sha_256_use_hw(path);
+		for (i = 0; i < sizeof(messages) / sizeof(messages[0]); i++) {
+			calc_sha_256(hash, messages[i], strlen(messages[i]));
+			if (memcmp(hash, expected[i], SIZE_OF_SHA_256_HASH) != 0)
+				failures++;
+		}
+		uint8_t block[1000];
+		struct Sha_256 sha_256;
+		memset(block, 'a', sizeof(block));
+		sha_256_init(&sha_256, hash);
+		for (i = 0; i < 1000; i++)
+			sha_256_write(&sha_256, block, sizeof(block));
+		sha_256_close(&sha_256);
+		if (memcmp(hash, million_a, SIZE_OF_SHA_256_HASH) != 0)
+			failures++;
+	}
+
+	/* Hardware against portable on pseudo-random inputs of every length up to a few chunks. */
+	if (paths == 2) {
+		uint8_t data[4 * SIZE_OF_SHA_256_CHUNK + 1];
+		uint32_t state = 0x9e3779b9;
+		size_t len;
+		for (len = 0; len < sizeof(data); len++) {
+			for (i = 0; i < len; i++)
+				data[i] = (uint8_t)self_test_rand(&state);
+			sha_256_use_hw(0);
+			calc_sha_256(hash, data, len);
+			sha_256_use_hw(1);
+			calc_sha_256(other, data, len);
+			if (memcmp(hash, other, SIZE_OF_SHA_256_HASH) != 0)
+				failures++;
+		}
+	}
+
+	consume_chunk = saved;
+	return failures;
+}
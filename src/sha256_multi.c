@@ -0,0 +1,90 @@
+#include "sha256.h"
+
+#define TOTAL_LEN_LEN 8
+
+/*
+ * Multi-buffer SHA-256: hashes several independent messages at once by giving each message its own SIMD lane.
+ *
+ * The widest kernel supported by the running CPU is chosen at load time. Without compiler support for the vector
+ * extensions (or on non-x86 targets) everything goes through the scalar calc_sha_256.
+ */
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SHA_256_MULTI_SIMD 1
+#endif
+
+#ifdef SHA_256_MULTI_SIMD
+
+/* Round constants, identical to the ones in sha256.c. */
+static const uint32_t sha_256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define KERNEL_NAME sha_256_many_avx2
+#define KERNEL_LANES 8
+#define KERNEL_TARGET "avx2"
+#include "sha256_multi_kernel.h"
+#undef KERNEL_NAME
+#undef KERNEL_LANES
+#undef KERNEL_TARGET
+
+#define KERNEL_NAME sha_256_many_avx512
+#define KERNEL_LANES 16
+#define KERNEL_TARGET "avx512f"
+#include "sha256_multi_kernel.h"
+#undef KERNEL_NAME
+#undef KERNEL_LANES
+#undef KERNEL_TARGET
+
+#endif
+
+/*
+ * Lane count of the selected kernel: 1 (scalar), 8 or 16. It is set once at load time, before any thread can call
+ * calc_sha_256_many, so concurrent callers only ever read it.
+ */
+static int selected_lanes = 1;
+
+#ifdef SHA_256_MULTI_SIMD
+__attribute__((constructor)) static void select_many_kernel(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		selected_lanes = 16;
+	else if (__builtin_cpu_supports("avx2"))
+		selected_lanes = 8;
+}
+#endif
+
+/*
+ * Public functions. See header file for documentation.
+ */
+
+int sha_256_many_lanes(void)
+{
+	return selected_lanes;
+}
+
+void calc_sha_256_many(uint8_t *hashes, const void *const inputs[], const size_t lens[], size_t n)
+{
+	size_t i = 0;
+#ifdef SHA_256_MULTI_SIMD
+	const size_t lanes = (size_t)sha_256_many_lanes();
+	/* A lone message is cheaper through the scalar path than through a mostly idle vector kernel. */
+	while (lanes > 1 && n - i >= 2) {
+		const size_t group = n - i < lanes ? n - i : lanes;
+		if (lanes == 16)
+			sha_256_many_avx512(hashes + i * SIZE_OF_SHA_256_HASH, inputs + i, lens + i, group);
+		else
+			sha_256_many_avx2(hashes + i * SIZE_OF_SHA_256_HASH, inputs + i, lens + i, group);
+		i += group;
+	}
+#endif
+	for (; i < n; i++)
+		calc_sha_256(hashes + i * SIZE_OF_SHA_256_HASH, inputs[i], lens[i]);
+}
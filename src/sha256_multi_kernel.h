@@ -0,0 +1,133 @@
+/*
+ * Lane-parallel SHA-256 kernel, included once per SIMD width by sha256_multi.c.
+ *
+ * The including file defines:
+ *   KERNEL_NAME   name of the generated function
+ *   KERNEL_LANES  number of messages hashed side by side (8 for AVX2, 16 for AVX-512)
+ *   KERNEL_TARGET target attribute string for the instruction set
+ *
+ * Each lane carries one message through the ordinary SHA-256 compression function; 32-bit word i of every lane
+ * sits in element i of a GCC/Clang vector, so one vector instruction advances every message by one step. Lanes
+ * whose message has fewer blocks than the longest one in the group keep running on dummy data, but their state
+ * update is masked out.
+ */
+
+__attribute__((target(KERNEL_TARGET))) static void KERNEL_NAME(uint8_t *hashes, const void *const inputs[],
+							    const size_t lens[], size_t n)
+{
+	typedef uint32_t vec __attribute__((vector_size(KERNEL_LANES * 4)));
+
+	uint8_t tail[KERNEL_LANES][2 * SIZE_OF_SHA_256_CHUNK];
+	size_t full[KERNEL_LANES];
+	uint32_t blocks[KERNEL_LANES] __attribute__((aligned(64)));
+	uint32_t words[16][KERNEL_LANES] __attribute__((aligned(64)));
+	uint32_t max_blocks = 0;
+	size_t l;
+	unsigned i;
+
+	/* Build the padded final block(s) of every lane up front. Unused lanes get zero blocks. */
+	for (l = 0; l < KERNEL_LANES; l++) {
+		if (l >= n) {
+			full[l] = 0;
+			blocks[l] = 0;
+			continue;
+		}
+		const size_t len = lens[l];
+		const size_t rem = len % SIZE_OF_SHA_256_CHUNK;
+		const size_t tail_len = rem + 1 + TOTAL_LEN_LEN <= SIZE_OF_SHA_256_CHUNK ? SIZE_OF_SHA_256_CHUNK
+											: 2 * SIZE_OF_SHA_256_CHUNK;
+		full[l] = len / SIZE_OF_SHA_256_CHUNK;
+		blocks[l] = (uint32_t)(full[l] + tail_len / SIZE_OF_SHA_256_CHUNK);
+		memcpy(tail[l], (const uint8_t *)inputs[l] + full[l] * SIZE_OF_SHA_256_CHUNK, rem);
+		tail[l][rem] = 0x80;
+		memset(tail[l] + rem + 1, 0x00, tail_len - rem - 1);
+		uint64_t bits = (uint64_t)len << 3;
+		int k;
+		for (k = 1; k <= TOTAL_LEN_LEN; k++) {
+			tail[l][tail_len - k] = (uint8_t)bits;
+			bits >>= 8;
+		}
+		if (blocks[l] > max_blocks)
+			max_blocks = blocks[l];
+	}
+
+	vec h[8];
+	static const uint32_t iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+				       0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+	for (i = 0; i < 8; i++)
+		h[i] = (vec){0} + iv[i];
+
+	vec lane_blocks;
+	memcpy(&lane_blocks, blocks, sizeof(lane_blocks));
+
+	uint32_t b;
+	for (b = 0; b < max_blocks; b++) {
+		/* Transpose the b-th block of every lane into big-endian message words. */
+		for (l = 0; l < KERNEL_LANES; l++) {
+			const uint8_t *p;
+			if (b < full[l])
+				p = (const uint8_t *)inputs[l] + (size_t)b * SIZE_OF_SHA_256_CHUNK;
+			else if (b < blocks[l])
+				p = tail[l] + (b - full[l]) * SIZE_OF_SHA_256_CHUNK;
+			else
+				p = tail[l];
+			for (i = 0; i < 16; i++, p += 4)
+				words[i][l] =
+				    (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+		}
+
+		vec w[16];
+		for (i = 0; i < 16; i++)
+			memcpy(&w[i], words[i], sizeof(vec));
+
+		vec ah[8];
+		for (i = 0; i < 8; i++)
+			ah[i] = h[i];
+
+		unsigned r;
+		for (r = 0; r < 64; r++) {
+			const unsigned j = r & 0xf;
+			if (r >= 16) {
+				const vec w1 = w[(j + 1) & 0xf];
+				const vec w14 = w[(j + 14) & 0xf];
+				const vec s0 = ((w1 >> 7) | (w1 << 25)) ^ ((w1 >> 18) | (w1 << 14)) ^ (w1 >> 3);
+				const vec s1 = ((w14 >> 17) | (w14 << 15)) ^ ((w14 >> 19) | (w14 << 13)) ^ (w14 >> 10);
+				w[j] = w[j] + s0 + w[(j + 9) & 0xf] + s1;
+			}
+			const vec e = ah[4];
+			const vec a = ah[0];
+			const vec s1 = ((e >> 6) | (e << 26)) ^ ((e >> 11) | (e << 21)) ^ ((e >> 25) | (e << 7));
+			const vec ch = (e & ah[5]) ^ (~e & ah[6]);
+			const vec temp1 = ah[7] + s1 + ch + sha_256_k[r] + w[j];
+			const vec s0 = ((a >> 2) | (a << 30)) ^ ((a >> 13) | (a << 19)) ^ ((a >> 22) | (a << 10));
+			const vec maj = (a & ah[1]) ^ (a & ah[2]) ^ (ah[1] & ah[2]);
+			const vec temp2 = s0 + maj;
+
+			ah[7] = ah[6];
+			ah[6] = ah[5];
+			ah[5] = e;
+			ah[4] = ah[3] + temp1;
+			ah[3] = ah[2];
+			ah[2] = ah[1];
+			ah[1] = a;
+			ah[0] = temp1 + temp2;
+		}
+
+		/* Only lanes that still had a real block take the update. */
+		const vec active = (vec)((vec){0} + b < lane_blocks);
+		for (i = 0; i < 8; i++)
+			h[i] += ah[i] & active;
+	}
+
+	for (i = 0; i < 8; i++)
+		memcpy(words[i], &h[i], sizeof(vec));
+	for (l = 0; l < n; l++) {
+		uint8_t *out = hashes + l * SIZE_OF_SHA_256_HASH;
+		for (i = 0; i < 8; i++) {
+			*out++ = (uint8_t)(words[i][l] >> 24);
+			*out++ = (uint8_t)(words[i][l] >> 16);
+			*out++ = (uint8_t)(words[i][l] >> 8);
+			*out++ = (uint8_t)words[i][l];
+		}
+	}
+}
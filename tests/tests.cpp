@@ -0,0 +1,322 @@
+// tests/tests.cpp
+//
+// Behaviour checks for the library: each test builds what it needs in memory or in a temporary
+// directory and checks the results with CHECK. Every failed check is printed with its line, and
+// the program exits with status 1 if any test failed.
+//
+// Usage: tests [--filter SUBSTRING]
+
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+#include "AccountRegistry.h"
+#include "BlockStore.h"
+#include "Blockchain.h"
+#include "BodyPool.h"
+#include "MerkleAccumulator.h"
+#include "MerkleTree.h"
+#include "Miner.h"
+#include "Transaction.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+
+string filter; // Run only tests whose name contains this
+int failures = 0; // Failed checks in the current test
+
+#define CHECK(condition)                                                            \
+    do {                                                                            \
+        if (!(condition)) {                                                         \
+            fprintf(stderr, "  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++failures;                                                             \
+        }                                                                           \
+    } while (0)
+
+// A few transfers between a handful of accounts, different for every seed
+vector<Transaction> makeTransactions(size_t count, size_t seed) {
+    vector<Transaction> transactions;
+    for (size_t i = 0; i < count; ++i) {
+        const size_t n = i + seed * count;
+        transactions.emplace_back("account" + to_string(n % 7), "account" + to_string(n * 3 % 5),
+                                  static_cast<int64_t>(n + 1) * 1000, 1700000000 + static_cast<int64_t>(n));
+    }
+    return transactions;
+}
+
+// Blocks validated once are not checked again: tampering with one goes unnoticed by
+// validateNewBlocks, while the same damage in a block added later is reported
+void testValidateNewBlocksChecksOnlyNewHeights() {
+    Blockchain blockchain;
+    for (size_t i = 0; i < 4; ++i) CHECK(blockchain.addBlock(makeTransactions(3, i)));
+    size_t failedIndex = 0;
+    CHECK(blockchain.validateNewBlocks(failedIndex));
+
+    blockchain.chain[2].transactions[0].amount += 1; // Breaks block 2's Merkle root
+    CHECK(!blockchain.validateChain(failedIndex));
+    CHECK(failedIndex == 2);
+
+    for (size_t i = 4; i < 6; ++i) CHECK(blockchain.addBlock(makeTransactions(3, i)));
+    CHECK(blockchain.validateNewBlocks(failedIndex)); // Heights 5 and 6 only
+
+    CHECK(blockchain.addBlock(makeTransactions(3, 6)));
+    CHECK(blockchain.addBlock(makeTransactions(3, 7)));
+    blockchain.chain[7].transactions[1].amount += 1;
+    CHECK(!blockchain.validateNewBlocks(failedIndex));
+    CHECK(failedIndex == 7);
+}
+
+// A fresh directory under the system temporary directory, removed again by the destructor
+struct TemporaryDirectory {
+    explicit TemporaryDirectory(const string& name)
+        : path(fs::temp_directory_path() / ("blockchain-test-" + name + "-" + to_string(time(nullptr)))) {
+        fs::remove_all(path);
+    }
+    ~TemporaryDirectory() { fs::remove_all(path); }
+
+    fs::path path;
+};
+
+// Blocks saved one append at a time still roll over to a new segment once one is full
+void testSingleBlockAppendsRollSegmentsOver() {
+    TemporaryDirectory directory("segments");
+    const uint64_t maxSegmentBytes = 4096;
+    Blockchain blockchain;
+    BlockStore store(directory.path.string(), maxSegmentBytes);
+    CHECK(store.open());
+    CHECK(store.append(blockchain.chain));
+    for (size_t i = 0; i < 40; ++i) {
+        CHECK(blockchain.addBlock(makeTransactions(10, i)));
+        CHECK(store.append(blockchain.chain));
+    }
+
+    size_t segments = 0;
+    for (const auto& entry : fs::directory_iterator(directory.path)) {
+        if (entry.path().filename().string().rfind("segment-", 0) != 0) continue;
+        ++segments;
+        // A segment only passes the limit by its last record
+        CHECK(fs::file_size(entry.path()) < 2 * maxSegmentBytes);
+    }
+    CHECK(segments > 1);
+
+    Blockchain loaded;
+    CHECK(loaded.loadFromFile(directory.path.string()));
+    CHECK(loaded.chain.size() == blockchain.chain.size());
+    CHECK(loaded.chain.back().hash() == blockchain.chain.back().hash());
+    CHECK(loaded.validateChain());
+}
+
+// A cancel aimed at a search that has not started stops it, while a cancel sent between
+// searches is not carried over to the next one
+void testMiningCancelTargetsOneSearch() {
+    Miner miner(2);
+    Block block(1, Hash256(), makeTransactions(2, 0));
+
+    miner.cancel(); // Nothing is running
+    block.difficulty = 8;
+    CHECK(miner.mine(block).found);
+    CHECK(Miner::meetsDifficulty(block.hash(), 8));
+
+    block.difficulty = 64; // Far out of reach: only a cancel ends this search
+    miner.cancel(miner.nextSearch());
+    CHECK(!miner.mine(block).found);
+
+    block.difficulty = 8;
+    CHECK(miner.mine(block).found); // The earlier cancel does not reach this search
+
+    Blockchain blockchain;
+    blockchain.setDifficulty(8);
+    blockchain.cancelMining(blockchain.nextMiningSearch());
+    CHECK(!blockchain.addBlock(makeTransactions(2, 1)));
+    CHECK(blockchain.chain.size() == 1);
+    CHECK(blockchain.addBlock(makeTransactions(2, 1)));
+    CHECK(blockchain.chain.size() == 2);
+}
+
+// A block's own header cannot lower the work validation asks for: a block carrying difficulty 0
+// fails once the chain requires more
+void testValidationEnforcesMinimumDifficulty() {
+    Blockchain blockchain;
+    CHECK(blockchain.addBlock(makeTransactions(2, 0))); // Difficulty 0
+    CHECK(blockchain.validateChain());
+
+    blockchain.setMinimumDifficulty(4);
+    CHECK(blockchain.getDifficulty() == 4);
+    size_t failedIndex = 0;
+    CHECK(!blockchain.validateChain(failedIndex));
+    CHECK(failedIndex == 1);
+
+    blockchain.setDifficulty(0); // Clamped to the minimum
+    CHECK(blockchain.getDifficulty() == 4);
+}
+
+// A block sealed from an accumulator and the caller's ids matches one built from a full tree,
+// and every id is indexed
+void testAccumulatorBlockMatchesTreeBlock() {
+    MerkleAccumulator leaves;
+    vector<Hash256> ids;
+    for (size_t count = 1; count <= 9; ++count) {
+        const vector<Transaction> transactions = makeTransactions(count, count);
+        leaves.clear();
+        ids.clear();
+        for (const Transaction& transaction : transactions) {
+            ids.push_back(MerkleTree::leafHash(transaction));
+            leaves.appendLeaf(ids.back());
+        }
+        CHECK(leaves.leafCount() == count);
+        CHECK(leaves.getRootHash() == MerkleTree(transactions).getRootHash());
+
+        Blockchain blockchain;
+        CHECK(blockchain.addBlock(vector<Transaction>(transactions), leaves, ids.data()));
+        CHECK(blockchain.chain.back().merkleRoot == MerkleTree(transactions).getRootHash());
+        for (size_t i = 0; i < count; ++i) {
+            TransactionLocation location;
+            CHECK(blockchain.findTransaction(ids[i], location));
+            CHECK(location.blockIndex == 1 && location.position == i);
+        }
+    }
+}
+
+// With a log writer running, a sealed block's body moves out of the chain into a handle shared
+// with the writer: reads and compaction are served from it until the store holds the block
+void testLogWriterSharesSealedBodies() {
+    TemporaryDirectory directory("writer");
+    const string path = directory.path.string();
+    Blockchain blockchain;
+    CHECK(blockchain.saveToFile(path));
+    CHECK(blockchain.openStore(path));
+    CHECK(blockchain.startLogWriter(2));
+
+    vector<vector<Transaction>> added;
+    for (size_t i = 0; i < 5; ++i) {
+        added.push_back(makeTransactions(4, i));
+        CHECK(blockchain.addBlock(added.back()));
+        CHECK(!blockchain.chain.back().bodyLoaded);
+        CHECK(blockchain.chain.back().transactions.empty());
+    }
+    for (size_t i = 0; i < added.size(); ++i) {
+        BlockCache::Body body = blockchain.getTransactions(i + 1);
+        CHECK(body && body->size() == added[i].size() && (*body)[0].amount == added[i][0].amount);
+    }
+    CHECK(blockchain.compactLog());
+    CHECK(blockchain.validateChain());
+
+    Blockchain loaded;
+    CHECK(loaded.loadFromFile(path));
+    CHECK(loaded.chain.size() == 6);
+    CHECK(loaded.validateChain());
+    CHECK(loaded.chain[3].transactions.size() == added[2].size());
+}
+
+// Account queries on a store opened header-only find the stored postings, and a name that is in
+// no block gives no results without being added to the registry
+void testAccountQueriesDoNotInternUnknownNames() {
+    TemporaryDirectory directory("accounts");
+    const string path = directory.path.string();
+    Blockchain written;
+    for (size_t i = 0; i < 6; ++i) CHECK(written.addBlock(makeTransactions(5, i)));
+    CHECK(written.saveToFile(path));
+    auto count = [](Blockchain& blockchain, const string& account) {
+        size_t matches = 0;
+        CHECK(blockchain.forEachAccountTransaction(account, AccountRole::Either,
+                                                   [&](const TransactionLocation&, const Transaction&) {
+                                                       ++matches;
+                                                       return true;
+                                                   }));
+        return matches;
+    };
+    const size_t expected = count(written, "account3");
+    CHECK(expected > 0);
+
+    Blockchain opened;
+    CHECK(opened.openStore(path));
+    const size_t names = AccountRegistry::global().size();
+    CHECK(count(opened, "no-such-account") == 0);
+    CHECK(count(opened, "no-such-account") == 0);
+    CHECK(AccountRegistry::global().size() == names);
+    CHECK(count(opened, "account3") == expected);
+    CHECK(count(opened, "account3") == expected); // From the posting list this time
+}
+
+// The pool keeps released buffers only up to its budget, and lowering the budget frees the excess
+void testBodyPoolKeepsToItsBudget() {
+    const size_t bufferBytes = 1000 * sizeof(Transaction);
+    BodyPool pool(3 * bufferBytes);
+    for (size_t i = 0; i < 5; ++i) {
+        vector<Transaction> body;
+        body.reserve(1000);
+        pool.release(move(body));
+    }
+    CHECK(pool.pooledBytes() <= 3 * bufferBytes);
+    CHECK(pool.pooledBytes() > 0);
+    CHECK(pool.acquire(1000).capacity() >= 1000);
+
+    pool.setBudget(0);
+    CHECK(pool.getBudget() == 0);
+    CHECK(pool.pooledBytes() == 0);
+}
+
+// Identical transactions share an id; it keeps pointing at the first one, also after the index is
+// rebuilt from the store
+void testRepeatedTransactionIdKeepsFirstLocation() {
+    TemporaryDirectory directory("duplicates");
+    const string path = directory.path.string();
+    const Transaction repeated("alice", "bob", 5000, 1700000000);
+    const Hash256 id = MerkleTree::leafHash(repeated);
+    Blockchain blockchain;
+    CHECK(blockchain.addBlock(vector<Transaction>{repeated, repeated}));
+    CHECK(blockchain.addBlock(makeTransactions(3, 1)));
+    CHECK(blockchain.addBlock(vector<Transaction>{makeTransactions(1, 2)[0], repeated}));
+
+    TransactionLocation location;
+    CHECK(blockchain.findTransaction(id, location));
+    CHECK(location.blockIndex == 1 && location.position == 0);
+
+    CHECK(blockchain.saveToFile(path));
+    Blockchain opened;
+    CHECK(opened.openStore(path));
+    CHECK(opened.findTransaction(id, location));
+    CHECK(location.blockIndex == 1 && location.position == 0);
+}
+
+struct Test {
+    const char* name;
+    function<void()> run;
+};
+
+const vector<Test> tests = {
+    {"validate_new_blocks_checks_only_new_heights", testValidateNewBlocksChecksOnlyNewHeights},
+    {"single_block_appends_roll_segments_over", testSingleBlockAppendsRollSegmentsOver},
+    {"mining_cancel_targets_one_search", testMiningCancelTargetsOneSearch},
+    {"validation_enforces_minimum_difficulty", testValidationEnforcesMinimumDifficulty},
+    {"accumulator_block_matches_tree_block", testAccumulatorBlockMatchesTreeBlock},
+    {"log_writer_shares_sealed_bodies", testLogWriterSharesSealedBodies},
+    {"account_queries_do_not_intern_unknown_names", testAccountQueriesDoNotInternUnknownNames},
+    {"body_pool_keeps_to_its_budget", testBodyPoolKeepsToItsBudget},
+    {"repeated_transaction_id_keeps_first_location", testRepeatedTransactionIdKeepsFirstLocation},
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc == 3 && string(argv[1]) == "--filter") {
+        filter = argv[2];
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: %s [--filter SUBSTRING]\n", argv[0]);
+        return 2;
+    }
+
+    int failed = 0;
+    for (const Test& test : tests) {
+        if (!filter.empty() && string(test.name).find(filter) == string::npos) continue;
+        failures = 0;
+        test.run();
+        fprintf(stderr, "%-48s %s\n", test.name, failures == 0 ? "PASS" : "FAIL");
+        if (failures != 0) ++failed;
+    }
+    return failed == 0 ? 0 : 1;
+}